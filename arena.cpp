@@ -0,0 +1,41 @@
+#include <algorithm>
+
+#include "arena.hpp"
+
+Arena::Arena() {
+    current = 0;
+    used = 0;
+}
+
+Arena::~Arena() {
+	for (auto &block : blocks) {
+		delete[] block.first;
+	}
+}
+
+/**
+ * @brief size bytes aligned to align, valid until the next reset()
+ * @details Blocks kept from earlier statements are used up in order
+ * before a new one is allocated.
+ */
+void *Arena::allocate(size_t size, size_t align) {
+	while (true) {
+		while (current < blocks.size()) {
+			uintptr_t base = (uintptr_t)blocks[current].first;
+			size_t offset = ((base + used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+			if (offset + size <= blocks[current].second) {
+				used = offset + size;
+				return blocks[current].first + offset;
+			}
+			current++;
+			used = 0;
+		}
+		size_t length = std::max(ARENA_BLOCK_SIZE, size + align);
+		blocks.push_back({new char[length], length});
+	}
+}
+
+void Arena::reset() {
+	current = 0;
+	used = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+//bytes of a block, larger allocations get a block of their own
+static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+/*********
+ ARENA CLASS
+ Bump allocator for the scratch memory of one statement.
+ allocate() moves an offset through the current block and
+ reset() hands everything back at once but keeps the blocks,
+ so once a statement ran, the ones after it get their scratch
+ without going to the heap. Nothing is destructed, only plain
+ bytes and trivially destructible objects belong here.
+*********/
+class Arena {
+	//(block, length)
+	std::vector<std::pair<char *, size_t>> blocks;
+	//block allocations are taken from and its first free byte
+	size_t current;
+	size_t used;
+
+public:
+	Arena();
+	~Arena();
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+	void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+	template <typename T>
+	inline T *allocate(size_t n) {
+		return static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void reset();
+};
+
+#endif
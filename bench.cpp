@@ -0,0 +1,431 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "table.hpp"
+#include "cursor.hpp"
+#include "node.hpp"
+#include "row.hpp"
+
+//rows a range scan reads
+static constexpr uint32_t BENCH_SCAN_LENGTH = 100;
+//hot spots the keys of the zipfian insert fall into
+static constexpr uint32_t BENCH_ZIPF_REGIONS = 1000;
+static constexpr double BENCH_ZIPF_THETA = 0.99;
+//inserts per transaction, so the numbers are about the tree and not fsync
+static constexpr uint32_t BENCH_INSERT_BATCH = 1000;
+
+typedef std::chrono::steady_clock Clock;
+
+/*
+ * Ranks 0..n-1 drawn with probability proportional to 1 / (rank + 1)^theta,
+ * the generator from Gray et al., "Quickly Generating Billion-Record
+ * Synthetic Databases", as YCSB uses it.
+ */
+class ZipfGenerator {
+	uint64_t n;
+	double theta;
+	double alpha;
+	double zetan;
+	double eta;
+
+	static double zeta(uint64_t n, double theta) {
+		double sum = 0;
+		for (uint64_t i = 1; i <= n; ++i) {
+			sum += 1 / std::pow((double)i, theta);
+		}
+		return sum;
+	}
+
+public:
+	ZipfGenerator(uint64_t n, double theta) : n(n), theta(theta) {
+	    alpha = 1 / (1 - theta);
+	    zetan = zeta(n, theta);
+	    eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / zetan);
+	}
+
+	template <typename Random>
+	uint64_t next(Random &random) {
+		double u = std::uniform_real_distribution<double>(0, 1)(random);
+		double uz = u * zetan;
+		if (uz < 1)
+			return 0;
+		if (uz < 1 + std::pow(0.5, theta))
+			return 1;
+		return std::min<uint64_t>(n - 1, n * std::pow(eta * u - eta + 1, alpha));
+	}
+};
+
+/*
+ * Time of every operation of a run, in nanoseconds
+ */
+class Latencies {
+	std::vector<uint64_t> samples;
+	Clock::time_point started;
+
+public:
+	inline void reserve(size_t n) {
+		samples.reserve(n);
+	}
+
+	inline void start() {
+		started = Clock::now();
+	}
+
+	inline void stop() {
+		samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count());
+	}
+
+	inline size_t count() {
+		return samples.size();
+	}
+
+	//q in [0, 1], call once every sample is in
+	uint64_t percentile(double q) {
+		if (samples.empty())
+			return 0;
+		size_t i = std::min(samples.size() - 1, (size_t)(q * samples.size()));
+		std::nth_element(samples.begin(), samples.begin() + i, samples.end());
+		return samples[i];
+	}
+};
+
+struct BenchResult {
+	std::string workload;
+	uint32_t rows;
+	uint64_t ops;
+	double seconds;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+};
+
+struct BenchOptions {
+	std::vector<uint32_t> rowCounts = {10000, 100000, 1000000};
+	uint32_t ops = 100000;
+	std::string path = "sqlite_bench.db";
+	std::string jsonPath;
+	uint32_t seed = 1;
+	PagerOptions pager;
+};
+
+static void fill_row(Row &row, uint32_t id) {
+	memset(&row, 0, sizeof(row));
+	row.id = id;
+	snprintf(row.username, Row::USERNAME_SIZE, "user%u", id);
+	snprintf(row.email, Row::EMAIL_SIZE, "user%u@example.com", id);
+}
+
+static void remove_files(const std::string &path) {
+	unlink(path.c_str());
+	unlink((path + "-wal").c_str());
+}
+
+/**
+ * @brief push the file to disk and drop it from the page cache, the
+ * next run starts with nothing cached above the disk
+ */
+static void drop_page_cache(const std::string &path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+/*********
+ BENCH CLASS
+ Runs the workloads on one table size. The inserts each start
+ from an empty file, the reads run on the table the random
+ insert left behind: warm right after it with the pool filled
+ by a full scan, cold after the table was closed, dropped from
+ the page cache and opened with an empty pool.
+*********/
+class Bench {
+	const BenchOptions &options;
+	uint32_t rows;
+	std::mt19937 random;
+	Table *table;
+	std::vector<BenchResult> &results;
+
+	void open(bool fresh);
+	void close();
+	void report(const std::string &workload, uint64_t ops, double seconds, Latencies &latencies);
+	void insert(const std::string &workload, const std::vector<uint32_t> &keys);
+	void lookup(const std::string &workload);
+	void scan(const std::string &workload);
+	void fullScan(const std::string &workload);
+
+public:
+	Bench(const BenchOptions &options, uint32_t rows, std::vector<BenchResult> &results)
+	    : options(options), rows(rows), random(options.seed), table(nullptr), results(results) {}
+
+	void run();
+};
+
+void Bench::open(bool fresh) {
+	if (fresh) {
+		remove_files(options.path);
+	}
+	table = new Table;
+	table->dbOpen(options.path, options.pager);
+}
+
+void Bench::close() {
+	table->dbClose();
+	delete table;
+	table = nullptr;
+}
+
+void Bench::report(const std::string &workload, uint64_t ops, double seconds, Latencies &latencies) {
+	BenchResult result{workload, rows, ops, seconds,
+	                   latencies.percentile(0.5), latencies.percentile(0.99), latencies.percentile(0.999)};
+	results.push_back(result);
+	printf("%-14s %10u %10lu %12.0f %10lu %10lu %10lu\n", workload.c_str(), rows,
+	       (unsigned long)ops, ops / seconds, (unsigned long)result.p50,
+	       (unsigned long)result.p99, (unsigned long)result.p999);
+	fflush(stdout);
+}
+
+/**
+ * @brief insert keys in order into an empty table, each insert timed
+ */
+void Bench::insert(const std::string &workload, const std::vector<uint32_t> &keys) {
+	open(true);
+	Latencies latencies;
+	latencies.reserve(keys.size());
+	Row row;
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < keys.size(); ++i) {
+		if (i % BENCH_INSERT_BATCH == 0) {
+			table->begin();
+		}
+		fill_row(row, keys[i]);
+		latencies.start();
+		table->insertRow(&row);
+		latencies.stop();
+		if (i % BENCH_INSERT_BATCH == BENCH_INSERT_BATCH - 1 || i + 1 == keys.size()) {
+			table->commit();
+		}
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	report(workload, keys.size(), seconds, latencies);
+}
+
+/**
+ * @brief point lookups of uniformly random keys
+ */
+void Bench::lookup(const std::string &workload) {
+	std::uniform_int_distribution<uint32_t> keys(1, rows);
+	Latencies latencies;
+	latencies.reserve(options.ops);
+	uint64_t found = 0;
+	Clock::time_point start = Clock::now();
+	for (uint32_t i = 0; i < options.ops; ++i) {
+		uint32_t key = keys(random);
+		latencies.start();
+		{
+			Cursor c = table->tableFind(key);
+			found += c.cellNum < *leaf_node_num_cells(c.node) && c.key() == key;
+		}
+		latencies.stop();
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	if (found != options.ops) {
+		std::cout << workload << ": " << options.ops - found << " keys not found\n";
+	}
+	report(workload, options.ops, seconds, latencies);
+}
+
+/**
+ * @brief range scans of BENCH_SCAN_LENGTH rows from random keys
+ */
+void Bench::scan(const std::string &workload) {
+	std::uniform_int_distribution<uint32_t> keys(1, rows);
+	uint32_t numOfScans = std::max<uint32_t>(1, options.ops / BENCH_SCAN_LENGTH);
+	Latencies latencies;
+	latencies.reserve(numOfScans);
+	Clock::time_point start = Clock::now();
+	for (uint32_t i = 0; i < numOfScans; ++i) {
+		uint32_t key = keys(random);
+		latencies.start();
+		{
+			Cursor c = table->tableSeek(key);
+			for (uint32_t n = 0; n < BENCH_SCAN_LENGTH && !c.endOfTable; ++n) {
+				c.advance();
+			}
+		}
+		latencies.stop();
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	report(workload, numOfScans, seconds, latencies);
+}
+
+/**
+ * @brief walk every row once, each step to the next row timed
+ */
+void Bench::fullScan(const std::string &workload) {
+	Latencies latencies;
+	latencies.reserve(rows);
+	Clock::time_point start = Clock::now();
+	latencies.start();
+	{
+		Cursor c = table->tableStart();
+		while (!c.endOfTable) {
+			latencies.stop();
+			latencies.start();
+			c.advance();
+		}
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	report(workload, latencies.count(), seconds, latencies);
+}
+
+void Bench::run() {
+	std::vector<uint32_t> keys(rows);
+	for (uint32_t i = 0; i < rows; ++i) {
+		keys[i] = i + 1;
+	}
+	insert("insert-seq", keys);
+	close();
+
+	//every region hands out increasing keys of its own, so the inserts
+	//pile up at the right end of a few hot leaves
+	ZipfGenerator zipf(BENCH_ZIPF_REGIONS, BENCH_ZIPF_THETA);
+	std::vector<uint32_t> nextInRegion(BENCH_ZIPF_REGIONS, 0);
+	uint32_t regionSize = rows / BENCH_ZIPF_REGIONS + 1;
+	std::vector<uint32_t> zipfKeys;
+	zipfKeys.reserve(rows);
+	while (zipfKeys.size() < rows) {
+		uint32_t region = zipf.next(random);
+		if (nextInRegion[region] < regionSize) {
+			zipfKeys.push_back(region * regionSize + ++nextInRegion[region]);
+		} else {
+			//a full region passes the insert on to the next one
+			for (uint32_t r = 0; r < BENCH_ZIPF_REGIONS; ++r) {
+				uint32_t other = (region + r) % BENCH_ZIPF_REGIONS;
+				if (nextInRegion[other] < regionSize) {
+					zipfKeys.push_back(other * regionSize + ++nextInRegion[other]);
+					break;
+				}
+			}
+		}
+	}
+	insert("insert-zipf", zipfKeys);
+	close();
+
+	std::shuffle(keys.begin(), keys.end(), random);
+	insert("insert-random", keys);
+	fullScan("full-scan");
+	lookup("lookup-warm");
+	scan("scan-warm");
+	close();
+
+	drop_page_cache(options.path);
+	open(false);
+	lookup("lookup-cold");
+	close();
+
+	drop_page_cache(options.path);
+	open(false);
+	scan("scan-cold");
+	close();
+
+	drop_page_cache(options.path);
+	open(false);
+	fullScan("full-scan-cold");
+	close();
+	remove_files(options.path);
+}
+
+static void write_json(const std::string &path, const BenchOptions &options,
+                       const std::vector<BenchResult> &results) {
+	std::ofstream out(path);
+	if (!out) {
+		std::cout << "Unable to write " << path << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	out << "{\n  \"page_size\": " << PAGE_SIZE
+	    << ",\n  \"frames\": " << options.pager.maxFrames
+	    << ",\n  \"mmap\": " << (options.pager.mode == PagerMode::Mmap ? "true" : "false")
+	    << ",\n  \"direct\": " << (options.pager.direct ? "true" : "false")
+	    << ",\n  \"seed\": " << options.seed
+	    << ",\n  \"results\": [";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchResult &r = results[i];
+		out << (i == 0 ? "\n" : ",\n")
+		    << "    {\"workload\": \"" << r.workload << "\", \"rows\": " << r.rows
+		    << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds
+		    << ", \"ops_per_sec\": " << r.ops / r.seconds
+		    << ", \"p50_ns\": " << r.p50 << ", \"p99_ns\": " << r.p99
+		    << ", \"p999_ns\": " << r.p999 << "}";
+	}
+	out << "\n  ]\n}\n";
+}
+
+static std::vector<uint32_t> parse_counts(const char *list) {
+	std::vector<uint32_t> counts;
+	std::stringstream in(list);
+	std::string item;
+	while (std::getline(in, item, ',')) {
+		//1e6 style counts are accepted too
+		uint32_t count = std::stod(item);
+		if (count > 0) {
+			counts.push_back(count);
+		}
+	}
+	return counts;
+}
+
+int main(int argc, char *argv[]) {
+	BenchOptions options;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+			options.rowCounts = parse_counts(argv[++i]);
+		} else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+			options.ops = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+			options.path = argv[++i];
+		} else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			options.jsonPath = argv[++i];
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			options.seed = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			options.pager.maxFrames = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--mmap") == 0) {
+			options.pager.mode = PagerMode::Mmap;
+		} else if (strcmp(argv[i], "--direct") == 0) {
+			options.pager.direct = true;
+		} else {
+			std::cout << "Unknown option " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+	if (options.rowCounts.empty() || options.ops == 0) {
+		std::cout << "Nothing to run\n";
+		return 1;
+	}
+
+	printf("%-14s %10s %10s %12s %10s %10s %10s\n", "workload", "rows", "ops",
+	       "ops/s", "p50 ns", "p99 ns", "p999 ns");
+	std::vector<BenchResult> results;
+	for (uint32_t rows : options.rowCounts) {
+		Bench bench(options, rows, results);
+		bench.run();
+	}
+	if (!options.jsonPath.empty()) {
+		write_json(options.jsonPath, options, results);
+	}
+	return 0;
+}
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+
+/*
+ * Shell of a server started with --listen: sends every line to the
+ * server and prints its answer, so it reads like the local shell.
+ */
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		std::cout << "Usage: sqlite_client <socket>\n";
+		return 1;
+	}
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(argv[1]) >= sizeof(address.sun_path)) {
+		std::cout << "Socket path too long\n";
+		return 1;
+	}
+	strcpy(address.sun_path, argv[1]);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) {
+		std::cout << "Unable to connect to " << argv[1] << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	std::string input;
+	std::string answer;
+	while (true) {
+		std::cout << "db > ";
+		if (!getline(std::cin, input) || input == ".exit")
+			break;
+
+		if (input.size() > MAX_REQUEST_SIZE) {
+			std::cout << "String too long\n";
+			continue;
+		}
+		if (!send_frame(fd, input.data(), input.size())) {
+			std::cout << "Connection to the server lost\n";
+			return 1;
+		}
+		while (true) {
+			if (!recv_frame(fd, answer)) {
+				std::cout << "Connection to the server lost\n";
+				return 1;
+			}
+			if (answer.empty())
+				break;
+			std::cout.write(answer.data(), answer.size());
+		}
+		std::cout.flush();
+	}
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,321 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "compressed_file.hpp"
+#include "pager.hpp"
+#include "lz.hpp"
+#include "stats.hpp"
+
+static inline uint32_t unitsFor(uint64_t length) {
+	return (length + COMPRESSED_UNIT_SIZE - 1) / COMPRESSED_UNIT_SIZE;
+}
+
+static inline off_t unitOffset(uint32_t unit) {
+	return (off_t)unit * COMPRESSED_UNIT_SIZE;
+}
+
+CompressedFile::CompressedFile(int fileDescriptor) {
+    this->fileDescriptor = fileDescriptor;
+    mapUnit = 0;
+    mapUnits = 0;
+    //the header takes the first unit
+    endUnit = 1;
+    pendingUnits = 0;
+    mapDirty = false;
+}
+
+bool CompressedFile::isCompressed(int fileDescriptor) {
+	uint32_t magic;
+	return pread(fileDescriptor, &magic, sizeof(magic), 0) == sizeof(magic) && magic == COMPRESSED_MAGIC;
+}
+
+void CompressedFile::_open() {
+	if (isCompressed(fileDescriptor)) {
+		load();
+		return;
+	}
+	//new file, the header makes it recognizable from now on
+	mapDirty = true;
+	sync();
+}
+
+/**
+ * @brief read the extent map and rebuild the free runs from it
+ * @details Every gap between the runs in use is free, so runs freed
+ * during the last session come back merged with their neighbours.
+ */
+void CompressedFile::load() {
+	CompressedHeader header;
+	if (pread(fileDescriptor, &header, sizeof(header), 0) != sizeof(header) || header.pageSize != PAGE_SIZE) {
+		std::cout << "DB file is corrupt!\n";
+		exit(EXIT_FAILURE);
+	}
+
+	extents.resize(header.numOfPages);
+	placed.assign(header.numOfPages, false);
+	mapUnit = header.mapUnit;
+	ssize_t mapLength = extents.size() * sizeof(Extent);
+	mapUnits = unitsFor(mapLength);
+	if (mapLength > 0 && pread(fileDescriptor, extents.data(), mapLength, unitOffset(mapUnit)) != mapLength) {
+		std::cout << "DB file is corrupt!\n";
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<std::pair<uint32_t, uint32_t>> used;
+	used.push_back({0, 1});
+	if (mapUnits > 0) {
+		used.push_back({mapUnit, mapUnits});
+	}
+	for (const Extent &extent : extents) {
+		if (extent.length > 0) {
+			used.push_back({extent.unit, extent.units});
+		}
+	}
+	std::sort(used.begin(), used.end());
+
+	std::vector<std::pair<uint32_t, uint32_t>> gaps;
+	endUnit = 0;
+	for (auto &run : used) {
+		if (run.first < endUnit) {
+			std::cout << "DB file is corrupt!\n";
+			exit(EXIT_FAILURE);
+		}
+		if (run.first > endUnit) {
+			gaps.push_back({endUnit, run.first - endUnit});
+		}
+		endUnit = run.first + run.second;
+	}
+	for (auto &gap : gaps) {
+		release(gap.first, gap.second);
+	}
+}
+
+/**
+ * @brief take units from the smallest free run that fits,
+ * growing the file if none does
+ * @details Call with mutex held.
+ */
+uint32_t CompressedFile::allocate(uint32_t units) {
+	auto it = freeBySize.lower_bound(units);
+	if (it == freeBySize.end()) {
+		uint32_t unit = endUnit;
+		endUnit += units;
+		return unit;
+	}
+
+	uint32_t length = it->first;
+	uint32_t unit = it->second;
+	freeBySize.erase(it);
+	freeRuns.erase(unit);
+	if (length > units) {
+		freeRuns[unit + units] = length - units;
+		freeBySize.insert({length - units, unit + units});
+	}
+	return unit;
+}
+
+/**
+ * @brief give a run back, merged with the free runs around it
+ * @details A run reaching the end of the file shortens the file instead.
+ * Call with mutex held.
+ */
+void CompressedFile::release(uint32_t unit, uint32_t units) {
+	auto forget = [this](std::map<uint32_t, uint32_t>::iterator run) {
+		auto range = freeBySize.equal_range(run->second);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second == run->first) {
+				freeBySize.erase(it);
+				break;
+			}
+		}
+		return freeRuns.erase(run);
+	};
+
+	auto next = freeRuns.lower_bound(unit);
+	if (next != freeRuns.end() && next->first == unit + units) {
+		units += next->second;
+		next = forget(next);
+	}
+	if (next != freeRuns.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == unit) {
+			unit = prev->first;
+			units += prev->second;
+			forget(prev);
+		}
+	}
+
+	if (unit + units == endUnit) {
+		endUnit = unit;
+		return;
+	}
+	freeRuns[unit] = units;
+	freeBySize.insert({units, unit});
+}
+
+/**
+ * @brief read and decompress the image of pageNum into dest
+ * @returns false if the page was never written
+ */
+bool CompressedFile::readPage(uint32_t pageNum, char *dest) {
+	char image[PAGE_SIZE];
+	Extent extent;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (pageNum >= extents.size() || extents[pageNum].length == 0)
+			return false;
+
+		extent = extents[pageNum];
+		char *target = extent.length == PAGE_SIZE ? dest : image;
+		if (pread(fileDescriptor, target, extent.length, unitOffset(extent.unit)) != extent.length) {
+			std::cout << "Error reading file\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+	stat_add(stats.bytesRead, extent.length);
+
+	if (extent.length != PAGE_SIZE && !lz_decompress(image, extent.length, dest, PAGE_SIZE)) {
+		std::cout << "DB file is corrupt!\n";
+		exit(EXIT_FAILURE);
+	}
+	return true;
+}
+
+/**
+ * @brief ask the kernel to read the images of a range of pages
+ * @details Images that follow each other in the file are requested
+ * as one range.
+ */
+void CompressedFile::prefetch(uint32_t firstPage, uint32_t numOfPages) {
+	std::vector<std::pair<uint32_t, uint32_t>> runs;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (uint32_t pageNum = firstPage; pageNum < firstPage + numOfPages && pageNum < extents.size(); ++pageNum) {
+			if (extents[pageNum].length > 0) {
+				runs.push_back({extents[pageNum].unit, extents[pageNum].units});
+			}
+		}
+	}
+	std::sort(runs.begin(), runs.end());
+
+	size_t i = 0;
+	while (i < runs.size()) {
+		uint32_t start = runs[i].first;
+		uint32_t end = start + runs[i].second;
+		for (i++; i < runs.size() && runs[i].first <= end; ++i) {
+			end = std::max(end, runs[i].first + runs[i].second);
+		}
+		posix_fadvise(fileDescriptor, unitOffset(start), unitOffset(end - start), POSIX_FADV_WILLNEED);
+	}
+}
+
+/**
+ * @brief compress page and write it as the image of pageNum
+ * @details The first write since the last sync() places the image on
+ * new units, the map on disk keeps naming the old ones until then.
+ */
+void CompressedFile::writePage(uint32_t pageNum, const char *page) {
+	char image[PAGE_SIZE];
+	const char *data = image;
+	uint32_t length = lz_compress(page, PAGE_SIZE, image, PAGE_SIZE - COMPRESSED_UNIT_SIZE);
+	if (length == 0) {
+		//compressing doesn't save a unit, store the page as it is
+		data = page;
+		length = PAGE_SIZE;
+	}
+	uint32_t units = unitsFor(length);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (pageNum >= extents.size()) {
+		extents.resize(pageNum + 1, Extent{0, 0, 0});
+		placed.resize(pageNum + 1, false);
+	}
+	Extent &extent = extents[pageNum];
+	if (!placed[pageNum] || units > extent.units) {
+		if (extent.length > 0 && placed[pageNum]) {
+			//nothing on disk points at it yet
+			release(extent.unit, extent.units);
+		} else if (extent.length > 0) {
+			pendingFree.push_back({extent.unit, extent.units});
+			pendingUnits += extent.units;
+		}
+		extent.unit = allocate(units);
+		extent.units = units;
+		placed[pageNum] = true;
+	}
+	extent.length = length;
+	mapDirty = true;
+
+	if (pwrite(fileDescriptor, data, length, unitOffset(extent.unit)) != (ssize_t)length) {
+		std::cout << "Error writing to file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+	stat_add(stats.bytesWritten, length);
+
+	if (pendingUnits >= std::max(COMPRESSED_SYNC_UNITS, endUnit / 8)) {
+		syncLocked();
+	}
+}
+
+/**
+ * @brief make the extent map on disk match the images written so far
+ * @details The map goes to fresh units and is synced before the header
+ * points at it, so the header always names a complete map. Only then
+ * are the old map and the units of moved images free for reuse.
+ */
+void CompressedFile::sync() {
+	std::lock_guard<std::mutex> lock(mutex);
+	syncLocked();
+}
+
+void CompressedFile::syncLocked() {
+	if (!mapDirty)
+		return;
+
+	ssize_t mapLength = extents.size() * sizeof(Extent);
+	uint32_t newUnits = unitsFor(mapLength);
+	uint32_t newUnit = newUnits > 0 ? allocate(newUnits) : 0;
+	if (mapLength > 0 && pwrite(fileDescriptor, extents.data(), mapLength, unitOffset(newUnit)) != mapLength) {
+		std::cout << "Error writing to file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+	if (fdatasync(fileDescriptor) == -1) {
+		std::cout << "Error syncing file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+
+	CompressedHeader header = {COMPRESSED_MAGIC, PAGE_SIZE, (uint32_t)extents.size(), newUnit};
+	if (pwrite(fileDescriptor, &header, sizeof(header), 0) != sizeof(header)) {
+		std::cout << "Error writing to file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+	stat_add(stats.bytesWritten, mapLength + sizeof(header));
+	if (fdatasync(fileDescriptor) == -1) {
+		std::cout << "Error syncing file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+
+	if (mapUnits > 0) {
+		release(mapUnit, mapUnits);
+	}
+	for (auto &run : pendingFree) {
+		release(run.first, run.second);
+	}
+	pendingFree.clear();
+	pendingUnits = 0;
+	mapUnit = newUnit;
+	mapUnits = newUnits;
+	mapDirty = false;
+	placed.assign(extents.size(), false);
+
+	//drop the units freed at the end of the file
+	if (ftruncate(fileDescriptor, unitOffset(endUnit)) == -1) {
+		std::cout << "Error truncating file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef COMPRESSED_FILE_H
+#define COMPRESSED_FILE_H
+
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <mutex>
+
+static constexpr uint32_t COMPRESSED_MAGIC = 0x5a4c5153;
+//page images are placed on units of this many bytes
+static constexpr uint32_t COMPRESSED_UNIT_SIZE = 128;
+//a write syncs the extent map once at least this many units wait to be freed
+static constexpr uint32_t COMPRESSED_SYNC_UNITS = 1024;
+
+/*
+ * Compressed File Layout
+ * The first unit holds the header, the rest of the file is page
+ * images and the extent map, each starting on a unit. The map has
+ * one extent per page: where its image starts, how long it is and
+ * how many units are set aside for it. An image as long as a page
+ * is stored uncompressed, a length of 0 means the page was never
+ * written.
+ */
+struct CompressedHeader {
+	uint32_t magic;
+	uint32_t pageSize;
+	uint32_t numOfPages;
+	//first unit of the extent map
+	uint32_t mapUnit;
+};
+
+struct Extent {
+	uint32_t unit;
+	uint16_t length;
+	uint16_t units;
+};
+
+/*********
+ COMPRESSED FILE CLASS
+ Database file holding every page as a compressed image. The
+ pager keeps pages uncompressed in its frames and only goes
+ through this class on a miss and on a write back, so a page
+ costs the bytes of its image on disk and in the page cache.
+
+ The image the map on disk points at is never overwritten: a
+ page written for the first time since the last sync() moves to
+ a free run, so a crash before the next sync() leaves the old map
+ with the old, whole images. Later writes before the sync reuse
+ the new run while they fit it. Units given up by a move are only
+ reused after the next sync(), the extent map on disk keeps
+ pointing at them until then. Once enough of them pile up a write
+ syncs on its own, so a file with many rewritten pages doesn't
+ keep growing too.
+*********/
+class CompressedFile {
+	int fileDescriptor;
+	std::vector<Extent> extents;
+	//the page's image was placed since the last sync, the map on disk doesn't name it
+	std::vector<bool> placed;
+	uint32_t mapUnit;
+	uint32_t mapUnits;
+	//first unit past everything in use
+	uint32_t endUnit;
+	//free runs by first unit -> length in units, and by length
+	std::map<uint32_t, uint32_t> freeRuns;
+	std::multimap<uint32_t, uint32_t> freeBySize;
+	//runs freed since the last sync
+	std::vector<std::pair<uint32_t, uint32_t>> pendingFree;
+	uint32_t pendingUnits;
+	bool mapDirty;
+	//guards the extents and the free runs, images are read and written under it
+	std::mutex mutex;
+
+	uint32_t allocate(uint32_t units);
+	void release(uint32_t unit, uint32_t units);
+	void load();
+	void syncLocked();
+
+public:
+	explicit CompressedFile(int fileDescriptor);
+
+	//true if the file starts with a compressed header
+	static bool isCompressed(int fileDescriptor);
+
+	void _open();
+
+	inline uint32_t getNumOfPages() {
+		return extents.size();
+	}
+
+	bool readPage(uint32_t pageNum, char *dest);
+	void prefetch(uint32_t firstPage, uint32_t numOfPages);
+	void writePage(uint32_t pageNum, const char *page);
+	void sync();
+};
+
+#endif
@@ -1,15 +1,127 @@
+#include <cstring>
+
 #include "cursor.hpp"
 #include "node.hpp"
 #include "table.hpp"
 
+Cursor::Cursor(Table *table, uint32_t pageNum, char *node, Latch mode)
+	: pageNum(pageNum), cellNum(0), endOfTable(false), table(table), node(node), mode(mode),
+	  copy(nullptr), snapshot(0), low(0) {
+}
+
+Cursor::Cursor(Table *table, uint32_t pageNum, char *node, uint64_t snapshot, uint32_t from, char *copy)
+	: pageNum(pageNum), cellNum(0), endOfTable(false), table(table), node(copy), mode(Latch::Shared),
+	  copy(copy), snapshot(snapshot), low(from) {
+	copyLeaf(node);
+}
+
+Cursor::Cursor(Cursor &&other)
+	: pageNum(other.pageNum), cellNum(other.cellNum), endOfTable(other.endOfTable), table(other.table),
+	  node(other.node), mode(other.mode), copy(other.copy), snapshot(other.snapshot),
+	  rows(std::move(other.rows)), older(std::move(other.older)), low(other.low) {
+	other.table = nullptr;
+}
+
+Cursor::~Cursor() {
+	release();
+}
+
+void Cursor::release() {
+	//a snapshot cursor let go of its latch after copying
+	if (table && !copy) {
+		table->getPager()->unlatchPage(pageNum, mode);
+	}
+	table = nullptr;
+}
+
+/**
+ * @brief take a copy of leaf, latched shared, let go of the latch and
+ * merge its cells with the older versions of the keys it covers
+ * @details The copy covers the keys from low up to its last key, the
+ * last leaf everything above. Versions of keys deleted from between two
+ * leaves are picked up by the next one.
+ */
+void Cursor::copyLeaf(char *leaf) {
+	memcpy(copy, leaf, PAGE_SIZE);
+	table->getPager()->unlatchPage(pageNum, Latch::Shared);
+
+	rows.clear();
+	uint32_t numCells = *leaf_node_num_cells(copy);
+	uint64_t high = *leaf_node_next_leaf(copy) == 0 ? UINT32_MAX
+	              : numCells > 0 ? leaf_node_key(copy, numCells - 1) : 0;
+	if (high < low)
+		return;
+	table->olderVersions(snapshot, low, high, older);
+
+	uint32_t i = 0;
+	size_t j = 0;
+	while (i < numCells || j < older.size()) {
+		uint32_t key = i < numCells ? leaf_node_key(copy, i) : UINT32_MAX;
+		if (i < numCells && key < low) {
+			i++;
+			continue;
+		}
+		if (j < older.size() && (i == numCells || older[j].key <= key)) {
+			if (older[j].existed) {
+				rows.push_back({older[j].key, older[j].record.data()});
+			}
+			if (i < numCells && older[j].key == key) {
+				i++;
+			}
+			j++;
+			continue;
+		}
+		rows.push_back({key, leaf_node_value(copy, i)});
+		i++;
+	}
+	low = high + 1;
+}
+
+uint32_t Cursor::key() {
+	if (copy)
+		return rows[cellNum].first;
+	return leaf_node_key(node, cellNum);
+}
+
 char* Cursor::value(){
-	char *page = table->getPager()->getPage(pageNum);
-	return leaf_node_value(page, cellNum);
+	if (copy)
+		return const_cast<char *>(rows[cellNum].second);
+	return leaf_node_value(node, cellNum);
 }
+
 void Cursor::advance() {
-	char *node = table->getPager()->getPage(pageNum);
 	cellNum++;
-	if (cellNum >= (*leaf_node_num_cells(node))) {
-		endOfTable = true;
+	skipExhaustedLeaves();
+}
+
+/**
+ * @brief if the cursor is past the last cell of its leaf, move it to
+ * the first cell of the next non-empty leaf or mark the end of the table
+ */
+void Cursor::skipExhaustedLeaves() {
+	Pager *pager = table->getPager();
+
+	while (cellNum >= (copy ? rows.size() : *leaf_node_num_cells(node))) {
+		uint32_t nextPageNum = *leaf_node_next_leaf(node);
+		if (nextPageNum == 0) {
+			endOfTable = true;
+			return;
+		}
+
+		char *next = pager->latchPage(nextPageNum, mode);
+		if (copy) {
+			pageNum = nextPageNum;
+			copyLeaf(next);
+		} else {
+			pager->unlatchPage(pageNum, mode);
+			pageNum = nextPageNum;
+			node = next;
+		}
+		cellNum = 0;
+		//leaves of random inserts aren't in page order, read-ahead
+		//on misses doesn't see the chain coming
+		if (*leaf_node_next_leaf(node) != 0) {
+			pager->prefetchPage(*leaf_node_next_leaf(node));
+		}
 	}
-}
\ No newline at end of file
+}
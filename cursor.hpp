@@ -2,19 +2,75 @@
 #define CURSOR_H
 
 #include <stdint.h>
+#include <vector>
+#include "pager.hpp"
+#include "version_store.hpp"
 class Table;
 
 /***************
  CURSOR CLASS
+ A cursor keeps the leaf page it points into latched (and
+ so pinned) until it is destroyed or released: shared for
+ reading, exclusive for the insert that created it. Cursors are
+ values that live on the stack of whoever asked for them,
+ moving one hands its latch over to the new one. Advancing
+ past the last cell of a leaf follows the next-leaf link,
+ latching the next leaf before letting go of the current
+ one, so a scan touches each leaf once and never goes back
+ to the root.
+
+ A snapshot cursor reads a copy of each leaf instead, into
+ a page the caller lends it for as long as it lives, and
+ holds the latch only while it copies. It shows every row
+ as of its snapshot: rows written since then are replaced
+ by what the version store kept of them. How fast its rows
+ are consumed never holds up the writer.
+
+ Keys only move left when a merge empties the page on the
+ right, and that page is not reused while an older snapshot
+ is open, so a cursor following the link of an old copy
+ still finds the rows there. Keys moving right are skipped
+ if the cursor already went past them.
 ***************/
 struct Cursor {
 	uint32_t pageNum;
 	uint32_t cellNum;
 	bool endOfTable;
+	//nullptr once moved from, the cursor holds nothing then
 	Table *table;
+	//the latched leaf, or the copy of a snapshot cursor
+	char *node;
+	Latch mode;
+	//nullptr unless this is a snapshot cursor
+	char *copy;
+	uint64_t snapshot;
+	//(key, record) of the rows the snapshot sees in the copy, in key order
+	std::vector<std::pair<uint32_t, const char *>> rows;
+	//rows written after the snapshot, for the keys of the copy
+	std::vector<RowVersion> older;
+	//keys below this were already passed
+	uint64_t low;
 
+	//takes over the latch the caller holds on pageNum
+	Cursor(Table *table, uint32_t pageNum, char *node, Latch mode);
+	//copies node, which the caller holds latched shared, into copy, a
+	//page that has to outlive the cursor, and lets go of the latch, the
+	//cursor starts at the first key >= from
+	Cursor(Table *table, uint32_t pageNum, char *node, uint64_t snapshot, uint32_t from, char *copy);
+	Cursor(Cursor &&other);
+	Cursor(const Cursor &) = delete;
+	Cursor &operator=(const Cursor &) = delete;
+	~Cursor();
+
+	uint32_t key();
 	char *value();
+	//let go of the leaf before the cursor goes away, it holds nothing then
+	void release();
 	void advance();
+	void skipExhaustedLeaves();
+
+private:
+	void copyLeaf(char *leaf);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,449 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#include "index.hpp"
+#include "node.hpp"
+
+Index::Index(Pager *pager, uint32_t rootPageNum)
+    : pager(pager), rootPageNum(rootPageNum) {
+}
+
+uint32_t Index::create(Pager *pager) {
+	uint32_t pageNum = pager->getUnusedPageNum();
+	char *root = pager->pinPage(pageNum);
+	initialize_leaf_node(root);
+	set_node_root(root, true);
+	*node_parent(root) = 0;
+	pager->markDirty(pageNum);
+	pager->unpinPage(pageNum);
+	return pageNum;
+}
+
+/**
+ * @brief order of two entries, by value and then by id
+ */
+int Index::compare(const Key &a, const Key &b) {
+	int result = a.value.compare(b.value);
+	if (result != 0)
+		return result < 0 ? -1 : 1;
+	return (a.id > b.id) - (a.id < b.id);
+}
+
+/**
+ * @brief the entry at entry, size is set to the bytes it takes
+ */
+Index::Key Index::readEntry(const char *entry, uint32_t &size) {
+	uint8_t length = *entry;
+	Key key;
+	key.value = std::string_view(entry + INDEX_LENGTH_SIZE, length);
+	memcpy(&key.id, entry + INDEX_LENGTH_SIZE + length, INDEX_ID_SIZE);
+	size = INDEX_LENGTH_SIZE + length + INDEX_ID_SIZE;
+	return key;
+}
+
+uint32_t Index::writeEntry(char *dest, const Key &key) {
+	*dest = (char)key.value.size();
+	memcpy(dest + INDEX_LENGTH_SIZE, key.value.data(), key.value.size());
+	memcpy(dest + INDEX_LENGTH_SIZE + key.value.size(), &key.id, INDEX_ID_SIZE);
+	return INDEX_LENGTH_SIZE + key.value.size() + INDEX_ID_SIZE;
+}
+
+/**
+ * @brief the shortest separator s with left <= s < right
+ * @details That is the shortest prefix of right's value that is
+ * greater than left's value, with the largest id. If no prefix is
+ * shorter than right's value itself, left is the separator.
+ */
+Index::Separator Index::separatorBetween(const Key &left, const Key &right) {
+	size_t common = 0;
+	while (common < left.value.size() && common < right.value.size() &&
+	       left.value[common] == right.value[common]) {
+		common++;
+	}
+
+	if (left.value != right.value && common + 1 < right.value.size()) {
+		return Separator{std::string(right.value.substr(0, common + 1)), UINT32_MAX};
+	}
+	return Separator{std::string(left.value), left.id};
+}
+
+/**
+ * @brief index of the first entry of the leaf >= key
+ */
+uint32_t Index::leafFind(char *node, const Key &key) {
+	uint32_t minIndex = 0;
+	uint32_t onePastMaxIndex = *leaf_node_num_cells(node);
+	uint32_t size;
+	while (minIndex != onePastMaxIndex) {
+		uint32_t index = (minIndex + onePastMaxIndex) / 2;
+		if (compare(readEntry(leaf_node_cell(node, index), size), key) >= 0) {
+			onePastMaxIndex = index;
+		} else {
+			minIndex = index + 1;
+		}
+	}
+	return minIndex;
+}
+
+/**
+ * @brief index of the child that should contain key, num_keys for the right child
+ * @details The key is compared with the node's prefix once, the binary
+ * search then only compares the rest of the key with the separators.
+ */
+uint32_t Index::findChild(char *node, const Key &key) {
+	uint32_t numKeys = *internal_node_num_keys(node);
+	uint32_t prefixLength = *index_internal_prefix_length(node);
+	std::string_view prefix(index_internal_prefix(node), prefixLength);
+
+	int result = key.value.substr(0, prefixLength).compare(prefix);
+	if (result < 0)
+		return 0;
+	if (result > 0)
+		return numKeys;
+
+	Key rest{key.value.substr(prefixLength), key.id};
+	uint32_t minIndex = 0;
+	uint32_t maxIndex = numKeys;
+	uint32_t size;
+	while (minIndex != maxIndex) {
+		uint32_t index = (minIndex + maxIndex) / 2;
+		if (compare(readEntry(index_internal_separator(node, index), size), rest) >= 0) {
+			maxIndex = index;
+		} else {
+			minIndex = index + 1;
+		}
+	}
+	return minIndex;
+}
+
+/**
+ * @brief walk from the root to the leaf that should hold key,
+ * latching the pages on the way exclusively and remembering them in path
+ * @details The whole path stays latched until the insert is done: a new
+ * separator can change the prefix a node stores, so no node is known to
+ * take it without being rewritten.
+ */
+uint32_t Index::descend(const Key &key) {
+	path.clear();
+	uint32_t pageNum = rootPageNum;
+	char *node = pager->latchPage(pageNum, Latch::Exclusive);
+	while (get_node_type(node) == NodeType::NodeInternal) {
+		path.push_back(pageNum);
+		pageNum = *index_internal_child(node, findChild(node, key));
+		node = pager->latchPage(pageNum, Latch::Exclusive);
+	}
+	path.push_back(pageNum);
+	return pageNum;
+}
+
+/**
+ * @brief decode the separators and children of an internal node
+ */
+void Index::readInternal(char *node, std::vector<Separator> &separators, std::vector<uint32_t> &children) {
+	uint32_t numKeys = *internal_node_num_keys(node);
+	std::string_view prefix(index_internal_prefix(node), *index_internal_prefix_length(node));
+	uint32_t size;
+	for (uint32_t i = 0; i < numKeys; ++i) {
+		Key rest = readEntry(index_internal_separator(node, i), size);
+		Separator separator{std::string(prefix), rest.id};
+		separator.value.append(rest.value);
+		separators.push_back(std::move(separator));
+		children.push_back(*index_internal_child(node, i));
+	}
+	children.push_back(*internal_node_right_child(node));
+}
+
+/**
+ * @brief bytes of the prefix numKeys sorted separators share
+ * @details The values are in order, so what the first one shares
+ * with the last one it shares with all of them.
+ */
+size_t Index::internalPrefixLength(const Separator *separators, uint32_t numKeys) {
+	if (numKeys == 0)
+		return 0;
+	const std::string &first = separators[0].value;
+	const std::string &last = separators[numKeys - 1].value;
+	size_t common = 0;
+	while (common < first.size() && common < last.size() && first[common] == last[common]) {
+		common++;
+	}
+	return common;
+}
+
+/**
+ * @brief bytes an internal node of numKeys sorted separators takes,
+ * with their prefix stored once
+ */
+size_t Index::internalSize(const Separator *separators, uint32_t numKeys) {
+	size_t prefixLength = internalPrefixLength(separators, numKeys);
+	size_t bytes = INDEX_INTERNAL_HEADER_SIZE + prefixLength;
+	for (uint32_t i = 0; i < numKeys; ++i) {
+		bytes += INDEX_INTERNAL_SLOT_SIZE + INDEX_LENGTH_SIZE +
+		         separators[i].value.size() - prefixLength + INDEX_ID_SIZE;
+	}
+	return bytes;
+}
+
+/**
+ * @brief encode numKeys sorted separators and numKeys + 1 children into node
+ * @return false if they don't fit, the node is left unchanged then
+ */
+bool Index::writeInternal(char *node, const Separator *separators, const uint32_t *children, uint32_t numKeys) {
+	if (internalSize(separators, numKeys) > PAGE_SIZE)
+		return false;
+	size_t prefixLength = internalPrefixLength(separators, numKeys);
+
+	bool isRoot = is_node_root(node);
+	initialize_internal_node(node);
+	set_node_root(node, isRoot);
+	*internal_node_num_keys(node) = numKeys;
+	*index_internal_prefix_length(node) = prefixLength;
+	if (numKeys > 0) {
+		memcpy(index_internal_prefix(node), separators[0].value.data(), prefixLength);
+	}
+
+	uint32_t offset = PAGE_SIZE;
+	for (uint32_t i = 0; i < numKeys; ++i) {
+		Key rest{std::string_view(separators[i].value).substr(prefixLength), separators[i].id};
+		offset -= INDEX_LENGTH_SIZE + rest.value.size() + INDEX_ID_SIZE;
+		writeEntry(node + offset, rest);
+
+		char *slot = index_internal_slot(node, i);
+		memcpy(slot, &children[i], INTERNAL_NODE_CHILD_SIZE);
+		uint16_t slotOffset = offset;
+		memcpy(slot + INTERNAL_NODE_CHILD_SIZE, &slotOffset, INDEX_INTERNAL_SLOT_OFFSET_SIZE);
+	}
+	*internal_node_right_child(node) = children[numKeys];
+	return true;
+}
+
+void Index::insert(std::string_view value, uint32_t id) {
+	char entry[INDEX_MAX_ENTRY_SIZE];
+	Key key{value.substr(0, Row::EMAIL_SIZE), id};
+	uint32_t size = writeEntry(entry, key);
+
+	uint32_t pageNum = descend(key);
+	char *node = pager->getPage(pageNum);
+	uint32_t cellNum = leafFind(node, key);
+
+	if (!leaf_node_insert_cell(node, cellNum, entry, size)) {
+		splitLeaf(pageNum, cellNum, entry, size);
+	} else {
+		pager->markDirty(pageNum);
+	}
+
+	for (uint32_t latched : path) {
+		pager->unlatchPage(latched, Latch::Exclusive);
+	}
+}
+
+void Index::remove(std::string_view value, uint32_t id) {
+	Key key{value.substr(0, Row::EMAIL_SIZE), id};
+	uint32_t pageNum = descend(key);
+	char *node = pager->getPage(pageNum);
+	uint32_t cellNum = leafFind(node, key);
+
+	uint32_t size;
+	if (cellNum < *leaf_node_num_cells(node) &&
+	    compare(readEntry(leaf_node_cell(node, cellNum), size), key) == 0) {
+		leaf_node_remove_cell(node, cellNum, size);
+		pager->markDirty(pageNum);
+	}
+
+	for (uint32_t latched : path) {
+		pager->unlatchPage(latched, Latch::Exclusive);
+	}
+}
+
+/**
+ * @brief split a full leaf in two halves of about the same bytes, the
+ * upper one on a new page right after it in the leaf chain, and insert entry
+ */
+void Index::splitLeaf(uint32_t pageNum, uint32_t cellNum, const char *entry, uint32_t size) {
+	char *node = pager->pinPage(pageNum);
+	char copy[PAGE_SIZE];
+	memcpy(copy, node, PAGE_SIZE);
+
+	uint32_t numCells = *leaf_node_num_cells(copy);
+	std::vector<std::pair<const char *, uint32_t>> cells;
+	cells.reserve(numCells + 1);
+	uint32_t totalBytes = 0;
+	for (uint32_t i = 0; i <= numCells; ++i) {
+		if (i == cellNum) {
+			cells.push_back({entry, size});
+		}
+		if (i < numCells) {
+			uint32_t cellSize;
+			const char *cell = leaf_node_cell(copy, i);
+			readEntry(cell, cellSize);
+			cells.push_back({cell, cellSize});
+		}
+	}
+	for (auto &cell : cells) {
+		totalBytes += cell.second + LEAF_NODE_SLOT_SIZE;
+	}
+
+	uint32_t leftCount = 0;
+	uint32_t leftBytes = 0;
+	while (leftCount + 1 < cells.size() && leftBytes < totalBytes / 2) {
+		leftBytes += cells[leftCount].second + LEAF_NODE_SLOT_SIZE;
+		leftCount++;
+	}
+
+	uint32_t newPageNum = pager->getUnusedPageNum();
+	char *newNode = pager->pinPage(newPageNum);
+	initialize_leaf_node(newNode);
+	*leaf_node_next_leaf(newNode) = *leaf_node_next_leaf(copy);
+
+	initialize_leaf_node(node);
+	set_node_root(node, is_node_root(copy));
+	*leaf_node_next_leaf(node) = newPageNum;
+	for (uint32_t i = 0; i < cells.size(); ++i) {
+		char *destNode = i < leftCount ? node : newNode;
+		leaf_node_insert_cell(destNode, *leaf_node_num_cells(destNode), cells[i].first, cells[i].second);
+	}
+
+	uint32_t unused;
+	Separator separator = separatorBetween(readEntry(cells[leftCount - 1].first, unused),
+	                                       readEntry(cells[leftCount].first, unused));
+
+	pager->markDirty(pageNum);
+	pager->markDirty(newPageNum);
+	pager->unpinPage(newPageNum);
+	pager->unpinPage(pageNum);
+
+	insertIntoParent(path.size() - 1, std::move(separator), newPageNum);
+}
+
+/**
+ * @brief the node at path[level] split, hang rightPageNum next to it
+ * @details The left half keeps its slot, now bounded by separator, and
+ * the right half takes over the old bound. A parent without room splits
+ * too, where its halves take the most even bytes with their own
+ * prefixes: the separator between them moves up a level.
+ */
+void Index::insertIntoParent(uint32_t level, Separator separator, uint32_t rightPageNum) {
+	if (level == 0) {
+		growRoot(separator, rightPageNum);
+		return;
+	}
+
+	uint32_t pageNum = path[level - 1];
+	char *node = pager->pinPage(pageNum);
+	uint32_t index = findChild(node, Key{separator.value, separator.id});
+
+	std::vector<Separator> separators;
+	std::vector<uint32_t> children;
+	readInternal(node, separators, children);
+	separators.insert(separators.begin() + index, std::move(separator));
+	children.insert(children.begin() + index + 1, rightPageNum);
+
+	if (writeInternal(node, separators.data(), children.data(), separators.size())) {
+		pager->markDirty(pageNum);
+		pager->unpinPage(pageNum);
+		return;
+	}
+
+	//each half stores its own prefix, which can be far shorter than
+	//the one the node had: pick the split whose bigger half takes the
+	//fewest bytes among those where both halves fit
+	uint32_t leftNumKeys = 0;
+	size_t bestBytes = PAGE_SIZE + 1;
+	for (uint32_t numKeys = 1; numKeys + 1 < separators.size(); ++numKeys) {
+		size_t bytes = std::max(internalSize(separators.data(), numKeys),
+		                        internalSize(separators.data() + numKeys + 1, separators.size() - numKeys - 1));
+		if (bytes < bestBytes) {
+			bestBytes = bytes;
+			leftNumKeys = numKeys;
+		}
+	}
+	if (leftNumKeys == 0) {
+		std::cout << "Index node can't be split into two that fit.\n";
+		exit(EXIT_FAILURE);
+	}
+	uint32_t rightNumKeys = separators.size() - leftNumKeys - 1;
+
+	uint32_t newPageNum = pager->getUnusedPageNum();
+	char *newNode = pager->pinPage(newPageNum);
+	initialize_internal_node(newNode);
+	if (!writeInternal(newNode, separators.data() + leftNumKeys + 1,
+	                   children.data() + leftNumKeys + 1, rightNumKeys) ||
+	    !writeInternal(node, separators.data(), children.data(), leftNumKeys)) {
+		std::cout << "Index node split into a half that doesn't fit.\n";
+		exit(EXIT_FAILURE);
+	}
+
+	pager->markDirty(pageNum);
+	pager->markDirty(newPageNum);
+	pager->unpinPage(newPageNum);
+	pager->unpinPage(pageNum);
+
+	insertIntoParent(level - 1, std::move(separators[leftNumKeys]), newPageNum);
+}
+
+/**
+ * @brief the root split, move its left half to a new page and turn
+ * the root into an internal node over both halves
+ */
+void Index::growRoot(const Separator &separator, uint32_t rightPageNum) {
+	char *root = pager->pinPage(rootPageNum);
+	uint32_t leftPageNum = pager->getUnusedPageNum();
+	char *left = pager->pinPage(leftPageNum);
+
+	memcpy(left, root, PAGE_SIZE);
+	set_node_root(left, false);
+
+	initialize_internal_node(root);
+	set_node_root(root, true);
+	uint32_t children[] = {leftPageNum, rightPageNum};
+	writeInternal(root, &separator, children, 1);
+
+	pager->markDirty(rootPageNum);
+	pager->markDirty(leftPageNum);
+	pager->unpinPage(leftPageNum);
+	pager->unpinPage(rootPageNum);
+}
+
+/**
+ * @brief append the ids of the rows whose column equals value to ids,
+ * in increasing order
+ * @details Latch crabbing: the next node is latched shared before
+ * the latch on the current one is given back, down the tree and
+ * along the leaf chain.
+ */
+void Index::find(std::string_view value, std::vector<uint32_t> &ids) {
+	Key key{value, 0};
+	uint32_t pageNum = rootPageNum;
+	char *node = pager->latchPage(pageNum, Latch::Shared);
+	while (get_node_type(node) == NodeType::NodeInternal) {
+		uint32_t childPageNum = *index_internal_child(node, findChild(node, key));
+		char *child = pager->latchPage(childPageNum, Latch::Shared);
+		pager->unlatchPage(pageNum, Latch::Shared);
+		pageNum = childPageNum;
+		node = child;
+	}
+
+	uint32_t cellNum = leafFind(node, key);
+	uint32_t size;
+	while (true) {
+		if (cellNum >= *leaf_node_num_cells(node)) {
+			uint32_t nextPageNum = *leaf_node_next_leaf(node);
+			if (nextPageNum == 0)
+				break;
+			char *next = pager->latchPage(nextPageNum, Latch::Shared);
+			pager->unlatchPage(pageNum, Latch::Shared);
+			pageNum = nextPageNum;
+			node = next;
+			cellNum = 0;
+			continue;
+		}
+
+		Key current = readEntry(leaf_node_cell(node, cellNum), size);
+		if (current.value != value)
+			break;
+		ids.push_back(current.id);
+		cellNum++;
+	}
+	pager->unlatchPage(pageNum, Latch::Shared);
+}
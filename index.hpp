@@ -0,0 +1,98 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <string_view>
+
+#include "pager.hpp"
+#include "row.hpp"
+
+enum class IndexColumn : uint32_t {
+	Username,
+	Email
+};
+
+//size of the indexed column, values in the index are padded to it
+static constexpr uint32_t INDEX_COLUMN_SIZE[] = {UserSchema::Column<USERNAME_COLUMN>::SIZE,
+                                                 UserSchema::Column<EMAIL_COLUMN>::SIZE};
+
+inline std::string_view record_column(const RecordView &record, IndexColumn column) {
+	return column == IndexColumn::Username ? record.username : record.email;
+}
+
+/*********
+ INDEX CLASS
+ Secondary index on a column of the table: a B+tree in the same
+ file as the table, mapping the column value to the ids of the
+ rows holding it. Lookups are one descent plus a walk along the
+ leaf chain while the value matches.
+
+ Entries take only the bytes of their value. Internal nodes hold
+ the shortest separator that tells two children apart and store
+ the prefix their separators share once, so they hold hundreds of
+ children even for long values, and searches compare against the
+ compressed separators in place.
+
+ The root stays on the page the index was created on. Splits
+ find their parents through the path of the last descent, so
+ index nodes don't keep parent pointers up to date. The path
+ belongs to the one writer of the table, find() crabs down with
+ shared latches on its own and can run on any number of threads.
+
+ Removing entries leaves underfull and even empty leaves behind,
+ lookups walk past them; .vacuum rebuilds the index packed.
+*********/
+class Index {
+	struct Key {
+		std::string_view value;
+		uint32_t id;
+	};
+
+	//a separator taken out of its node
+	struct Separator {
+		std::string value;
+		uint32_t id;
+	};
+
+	Pager *pager;
+	uint32_t rootPageNum;
+	//pages from the root down to the leaf of the last descent
+	std::vector<uint32_t> path;
+
+	static int compare(const Key &a, const Key &b);
+	static Key readEntry(const char *entry, uint32_t &size);
+	static uint32_t writeEntry(char *dest, const Key &key);
+	static Separator separatorBetween(const Key &left, const Key &right);
+
+	uint32_t descend(const Key &key);
+	uint32_t leafFind(char *node, const Key &key);
+	uint32_t findChild(char *node, const Key &key);
+	void readInternal(char *node, std::vector<Separator> &separators, std::vector<uint32_t> &children);
+	static size_t internalPrefixLength(const Separator *separators, uint32_t numKeys);
+	static size_t internalSize(const Separator *separators, uint32_t numKeys);
+	bool writeInternal(char *node, const Separator *separators, const uint32_t *children, uint32_t numKeys);
+	void splitLeaf(uint32_t pageNum, uint32_t cellNum, const char *entry, uint32_t size);
+	void insertIntoParent(uint32_t level, Separator separator, uint32_t rightPageNum);
+	void growRoot(const Separator &separator, uint32_t rightPageNum);
+
+public:
+	Index(Pager *pager, uint32_t rootPageNum);
+
+	//set up an empty index on a new page, returns its root page
+	static uint32_t create(Pager *pager);
+
+	inline uint32_t getRootPageNum() {
+		return rootPageNum;
+	}
+
+	void insert(std::string_view value, uint32_t id);
+
+	//take the entry of (value, id) out, leaves are not merged
+	void remove(std::string_view value, uint32_t id);
+
+	void find(std::string_view value, std::vector<uint32_t> &ids);
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "lexer.hpp"
+
+static inline bool is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+static inline bool is_punctuation(char c) {
+	return c == ',' || c == '=' || c == '<' || c == '>' || c == '(' || c == ')';
+}
+
+static inline char to_lower(char c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+Lexer::Lexer(std::string_view input) : input(input), pos(0) {
+	current = scan();
+}
+
+Token Lexer::scan() {
+	while (pos < input.size() && is_space(input[pos])) {
+		pos++;
+	}
+	if (pos == input.size()) {
+		return Token{TokenType::End, input.substr(pos, 0), pos};
+	}
+
+	size_t start = pos;
+	char c = input[pos];
+	if (is_punctuation(c)) {
+		pos++;
+		TokenType type;
+		switch (c) {
+			case ',': type = TokenType::Comma; break;
+			case '(': type = TokenType::LeftParen; break;
+			case ')': type = TokenType::RightParen; break;
+			case '=': type = TokenType::Equal; break;
+			case '<':
+				type = TokenType::Less;
+				if (pos < input.size() && input[pos] == '=') {
+					type = TokenType::LessEqual;
+					pos++;
+				}
+				break;
+			default:
+				type = TokenType::Greater;
+				if (pos < input.size() && input[pos] == '=') {
+					type = TokenType::GreaterEqual;
+					pos++;
+				}
+				break;
+		}
+		return Token{type, input.substr(start, pos - start), start};
+	}
+
+	bool number = true;
+	bool digits = false;
+	if (c == '-') {
+		pos++;
+	}
+	while (pos < input.size() && !is_space(input[pos]) && !is_punctuation(input[pos])) {
+		if (is_digit(input[pos])) {
+			digits = true;
+		} else {
+			number = false;
+		}
+		pos++;
+	}
+
+	TokenType type = (number && digits) ? TokenType::Number : TokenType::Word;
+	return Token{type, input.substr(start, pos - start), start};
+}
+
+/**
+ * @brief returns the current token and moves to the next one
+ */
+Token Lexer::next() {
+	Token token = current;
+	current = scan();
+	return token;
+}
+
+/**
+ * @brief consume the current token if it has the given type
+ */
+bool Lexer::accept(TokenType type) {
+	if (current.type != type)
+		return false;
+	next();
+	return true;
+}
+
+/**
+ * @brief true if the current token is keyword, ignoring case
+ */
+bool Lexer::isKeyword(std::string_view keyword) const {
+	if (current.type != TokenType::Word || current.text.size() != keyword.size())
+		return false;
+
+	for (size_t i = 0; i < keyword.size(); ++i) {
+		if (to_lower(current.text[i]) != keyword[i])
+			return false;
+	}
+	return true;
+}
+
+bool Lexer::acceptKeyword(std::string_view keyword) {
+	if (!isKeyword(keyword))
+		return false;
+	next();
+	return true;
+}
@@ -0,0 +1,57 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stddef.h>
+#include <string_view>
+
+enum class TokenType {
+	//a run of characters up to whitespace or punctuation
+	Word,
+	//digits, optionally with a leading minus
+	Number,
+	Comma,
+	Equal,
+	Less,
+	LessEqual,
+	Greater,
+	GreaterEqual,
+	LeftParen,
+	RightParen,
+	End
+};
+
+struct Token {
+	TokenType type;
+	//points into the lexed input, no copy
+	std::string_view text;
+	//offset of the token in the input
+	size_t pos;
+};
+
+/***************
+ LEXER CLASS
+ Splits a statement into tokens without copying or
+ allocating, every token is a view into the input.
+ The input has to outlive the lexer and its tokens.
+***************/
+class Lexer {
+	std::string_view input;
+	size_t pos;
+	Token current;
+
+	Token scan();
+
+public:
+	explicit Lexer(std::string_view input);
+
+	inline const Token &peek() const {
+		return current;
+	}
+
+	Token next();
+	bool accept(TokenType type);
+	bool acceptKeyword(std::string_view keyword);
+	bool isKeyword(std::string_view keyword) const;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cstring>
+
+#include "lz.hpp"
+
+//positions of earlier 4 byte sequences, by hash
+static constexpr uint32_t LZ_HASH_BITS = 12;
+static constexpr uint32_t LZ_NO_POSITION = UINT32_MAX;
+
+static inline uint32_t read32(const char *p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32_t hash32(uint32_t value) {
+	return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+//writes the part of a length that didn't fit its nibble
+static char *writeLength(char *out, size_t length) {
+	while (length >= 255) {
+		*out++ = (char)255;
+		length -= 255;
+	}
+	*out++ = (char)length;
+	return out;
+}
+
+static bool readLength(const uint8_t *&in, const uint8_t *end, size_t &length) {
+	uint8_t byte;
+	do {
+		if (in == end)
+			return false;
+		byte = *in++;
+		length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+/**
+ * @brief append one sequence, a matchLength of 0 ends the block
+ * @returns the new end of the output, nullptr if it doesn't fit
+ */
+static char *writeSequence(char *out, const char *end, const char *literals, size_t numLiterals,
+                           size_t offset, size_t matchLength) {
+	size_t worst = 1 + numLiterals / 255 + 1 + numLiterals + 2 + matchLength / 255 + 1;
+	if (worst > (size_t)(end - out))
+		return nullptr;
+
+	size_t matchCode = matchLength > 0 ? matchLength - LZ_MIN_MATCH : 0;
+	*out++ = (char)((std::min<size_t>(numLiterals, 15) << 4) | std::min<size_t>(matchCode, 15));
+	if (numLiterals >= 15) {
+		out = writeLength(out, numLiterals - 15);
+	}
+	memcpy(out, literals, numLiterals);
+	out += numLiterals;
+
+	if (matchLength == 0)
+		return out;
+
+	*out++ = (char)(offset & 0xff);
+	*out++ = (char)(offset >> 8);
+	if (matchCode >= 15) {
+		out = writeLength(out, matchCode - 15);
+	}
+	return out;
+}
+
+/**
+ * @brief greedy LZ77 with a single hash probe per position
+ * @details Pages are mostly small records and runs of zeroes, one probe
+ * finds those matches and keeps compression cheap enough for every flush.
+ */
+size_t lz_compress(const char *src, size_t n, char *dest, size_t capacity) {
+	uint32_t table[1 << LZ_HASH_BITS];
+	std::fill(table, table + (1 << LZ_HASH_BITS), LZ_NO_POSITION);
+
+	char *out = dest;
+	const char *end = dest + capacity;
+	size_t anchor = 0;
+	size_t i = 0;
+	while (i + LZ_MIN_MATCH <= n) {
+		uint32_t value = read32(src + i);
+		uint32_t h = hash32(value);
+		uint32_t candidate = table[h];
+		table[h] = i;
+
+		if (candidate == LZ_NO_POSITION || i - candidate > LZ_MAX_OFFSET || read32(src + candidate) != value) {
+			i++;
+			continue;
+		}
+
+		size_t length = LZ_MIN_MATCH;
+		while (i + length < n && src[candidate + length] == src[i + length]) {
+			length++;
+		}
+
+		out = writeSequence(out, end, src + anchor, i - anchor, i - candidate, length);
+		if (out == nullptr)
+			return 0;
+		i += length;
+		anchor = i;
+	}
+
+	out = writeSequence(out, end, src + anchor, n - anchor, 0, 0);
+	return out == nullptr ? 0 : out - dest;
+}
+
+bool lz_decompress(const char *src, size_t n, char *dest, size_t expected) {
+	const uint8_t *in = reinterpret_cast<const uint8_t *>(src);
+	const uint8_t *inEnd = in + n;
+	char *out = dest;
+	char *outEnd = dest + expected;
+
+	while (in < inEnd) {
+		uint8_t token = *in++;
+
+		size_t numLiterals = token >> 4;
+		if (numLiterals == 15 && !readLength(in, inEnd, numLiterals))
+			return false;
+		if (numLiterals > (size_t)(inEnd - in) || numLiterals > (size_t)(outEnd - out))
+			return false;
+		memcpy(out, in, numLiterals);
+		in += numLiterals;
+		out += numLiterals;
+
+		if (in == inEnd)
+			break;
+
+		if (inEnd - in < 2)
+			return false;
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		size_t length = token & 15;
+		if (length == 15 && !readLength(in, inEnd, length))
+			return false;
+		length += LZ_MIN_MATCH;
+		if (offset == 0 || offset > (size_t)(out - dest) || length > (size_t)(outEnd - out))
+			return false;
+
+		const char *match = out - offset;
+		if (offset >= length) {
+			memcpy(out, match, length);
+		} else {
+			//the match overlaps what it produces, copy byte by byte
+			for (size_t k = 0; k < length; ++k) {
+				out[k] = match[k];
+			}
+		}
+		out += length;
+	}
+	return out == outEnd;
+}
@@ -0,0 +1,32 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Compressed Block Layout
+ * A block is a run of sequences. Every sequence starts with a
+ * token byte: the high nibble is the number of literals, the low
+ * nibble the match length minus LZ_MIN_MATCH. A nibble of 15 is
+ * followed by extension bytes that are added to it, 255 meaning
+ * another byte follows. Then come the literals, then the match
+ * offset (2 bytes) and the match extension bytes. The last
+ * sequence of a block has literals only.
+ */
+static constexpr uint32_t LZ_MIN_MATCH = 4;
+static constexpr uint32_t LZ_MAX_OFFSET = 65535;
+
+/**
+ * @brief compress n bytes of src into dest
+ * @returns the compressed size, or 0 if it doesn't fit in capacity
+ */
+size_t lz_compress(const char *src, size_t n, char *dest, size_t capacity);
+
+/**
+ * @brief decompress a block of n bytes into exactly expected bytes of dest
+ * @returns false if the block is corrupt
+ */
+bool lz_decompress(const char *src, size_t n, char *dest, size_t expected);
+
+#endif
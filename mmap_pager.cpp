@@ -0,0 +1,212 @@
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "mmap_pager.hpp"
+#include "stats.hpp"
+
+MmapPager::MmapPager(const PagerOptions &options) noexcept
+    : Pager(options) {
+    base = nullptr;
+    mappedLength = 0;
+    capacity = 0;
+    numOfPinned = 0;
+    numOfMappedPages = 0;
+}
+
+MmapPager::~MmapPager() {
+    if (base) {
+        munmap(base, mappedLength);
+        base = nullptr;
+    }
+}
+
+void MmapPager::_open(std::string filename) {
+	fileDescriptor = open(filename.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fileDescriptor == -1) {
+		std::cout << "Unable to open file\n";
+		exit(EXIT_FAILURE);
+	}
+
+	if (CompressedFile::isCompressed(fileDescriptor)) {
+		std::cout << "A compressed database can't be mapped, open it without --mmap.\n";
+		exit(EXIT_FAILURE);
+	}
+
+	replayWal(filename);
+
+	struct stat st;
+	if (fstat(fileDescriptor, &st) == -1) {
+		std::cout << "Unable to stat file\n";
+		exit(EXIT_FAILURE);
+	}
+	fileLength = st.st_size;
+	numOfPages = fileLength / PAGE_SIZE;
+	capacity = fileLength;
+	numOfMappedPages = numOfPages;
+
+	if (fileLength % PAGE_SIZE != 0) {
+		std::cout << "DB file is corrupt!\n";
+	}
+
+	remap(capacity > MMAP_RESERVE_SIZE ? capacity * 2 : MMAP_RESERVE_SIZE);
+}
+
+/**
+ * @brief (re)map the file into length bytes of address space
+ * @details Pages past the end of the file are mapped too, they become
+ * usable once the file is extended. Moving the mapping would leave
+ * pinned pointers dangling, so that is only allowed with nothing pinned.
+ */
+void MmapPager::remap(uint64_t length) {
+	void *addr;
+	if (base == nullptr) {
+		addr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+		            MAP_SHARED | MAP_NORESERVE, fileDescriptor, 0);
+	} else {
+		if (numOfPinned > 0) {
+			std::cout << "Cannot remap the database while pages are pinned.\n";
+			exit(EXIT_FAILURE);
+		}
+		addr = mremap(base, mappedLength, length, MREMAP_MAYMOVE);
+	}
+
+	if (addr == MAP_FAILED) {
+		std::cout << "Error mapping file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+	base = static_cast<char *>(addr);
+	mappedLength = length;
+}
+
+/**
+ * @brief make sure the file backs at least length bytes
+ */
+void MmapPager::grow(uint64_t length) {
+	if (length <= capacity)
+		return;
+
+	uint64_t newCapacity = capacity + MMAP_GROW_CHUNK;
+	if (newCapacity < length) {
+		newCapacity = length;
+	}
+
+	if (newCapacity > mappedLength) {
+		remap(newCapacity * 2);
+	}
+
+	if (ftruncate(fileDescriptor, newCapacity) == -1) {
+		std::cout << "Error extending file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+	capacity = newCapacity;
+	fileLength = newCapacity;
+}
+
+/**
+ * @brief returns the page at pageNum, a pointer into the mapping
+ */
+char *MmapPager::getPage(uint32_t pageNum) {
+	if (pageNum >= numOfMappedPages.load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> lock(growMutex);
+		if (pageNum >= numOfPages) {
+			//new pages read as zeroes after the file is extended
+			grow((uint64_t)(pageNum + 1) * PAGE_SIZE);
+			numOfPages = pageNum + 1;
+		}
+		numOfMappedPages.store(numOfPages, std::memory_order_release);
+	}
+	return base + (uint64_t)pageNum * PAGE_SIZE;
+}
+
+char *MmapPager::pinPage(uint32_t pageNum) {
+	char *page = getPage(pageNum);
+	numOfPinned++;
+	return page;
+}
+
+void MmapPager::unpinPage(uint32_t pageNum) {
+	if (numOfPinned == 0) {
+		std::cout << "Tried to unpin page " << pageNum << " which is not pinned.\n";
+		exit(EXIT_FAILURE);
+	}
+	numOfPinned--;
+}
+
+std::shared_mutex &MmapPager::pageLatch(uint32_t pageNum) {
+	std::lock_guard<std::mutex> lock(latchesMutex);
+	if (pageNum >= latches.size()) {
+		latches.resize(pageNum + 1);
+	}
+	if (!latches[pageNum]) {
+		latches[pageNum].reset(new std::shared_mutex);
+	}
+	return *latches[pageNum];
+}
+
+char *MmapPager::latchPage(uint32_t pageNum, Latch mode) {
+	char *page = pinPage(pageNum);
+	if (mode == Latch::Shared) {
+		pageLatch(pageNum).lock_shared();
+	} else {
+		pageLatch(pageNum).lock();
+	}
+	return page;
+}
+
+void MmapPager::unlatchPage(uint32_t pageNum, Latch mode) {
+	if (mode == Latch::Shared) {
+		pageLatch(pageNum).unlock_shared();
+	} else {
+		pageLatch(pageNum).unlock();
+	}
+	unpinPage(pageNum);
+}
+
+/**
+ * @brief stores go straight to the shared mapping, the kernel
+ * tracks dirty pages for us
+ */
+void MmapPager::markDirty(uint32_t) {
+}
+
+void MmapPager::_flush(uint32_t pageNum) {
+	stat_add(stats.flushes);
+	if (pageNum >= numOfPages) {
+		std::cout << "Tried to flush null page. Exiting..." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	if (msync(base + (uint64_t)pageNum * PAGE_SIZE, PAGE_SIZE, MS_SYNC) == -1) {
+		std::cout << "Error writing to file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+}
+
+void MmapPager::flushAll() {
+	stat_add(stats.flushes);
+	if (numOfPages == 0)
+		return;
+
+	if (msync(base, (uint64_t)numOfPages * PAGE_SIZE, MS_SYNC) == -1) {
+		std::cout << "Error writing to file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+}
+
+int MmapPager::_close() {
+	munmap(base, mappedLength);
+	base = nullptr;
+
+	//drop the unused tail of the last growth chunk
+	fileLength = (uint64_t)numOfPages * PAGE_SIZE;
+	if (ftruncate(fileDescriptor, fileLength) == -1) {
+		std::cout << "Error truncating file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+	return close(fileDescriptor);
+}
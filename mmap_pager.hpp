@@ -0,0 +1,57 @@
+#ifndef MMAP_PAGER_H
+#define MMAP_PAGER_H
+
+#include <stddef.h>
+#include <memory>
+#include "pager.hpp"
+
+//virtual address space reserved for the mapping up front (64 GB),
+//so growing the file never moves pages that are already handed out
+static constexpr uint64_t MMAP_RESERVE_SIZE = 1ULL << 36;
+//the file is extended in chunks of this many bytes
+static constexpr uint64_t MMAP_GROW_CHUNK = 256 * PAGE_SIZE;
+
+/*********
+ MMAP PAGER CLASS
+ Maps the whole database file with a shared mapping and hands
+ out page pointers straight into it. There is no copy into a
+ frame and no read() on a miss, the OS page cache decides what
+ stays resident. Growing the file only needs an ftruncate while
+ it fits the reserved range, past that the mapping is remapped.
+*********/
+class MmapPager : public Pager {
+	char *base;
+	//bytes of address space mapped
+	uint64_t mappedLength;
+	//bytes of the file backing the mapping
+	uint64_t capacity;
+	std::atomic<uint32_t> numOfPinned;
+	//pages readers can use without growing the file, numOfPages
+	//itself only changes under growMutex
+	std::atomic<uint32_t> numOfMappedPages;
+	std::mutex growMutex;
+	//latches by page number, created on first use
+	std::vector<std::unique_ptr<std::shared_mutex>> latches;
+	std::mutex latchesMutex;
+
+	void grow(uint64_t length);
+	void remap(uint64_t length);
+	std::shared_mutex &pageLatch(uint32_t pageNum);
+
+public:
+	explicit MmapPager(const PagerOptions &options = PagerOptions()) noexcept;
+	~MmapPager() override;
+
+	void _open(std::string filename) override;
+	char *getPage(uint32_t pageNum) override;
+	char *pinPage(uint32_t pageNum) override;
+	void unpinPage(uint32_t pageNum) override;
+	char *latchPage(uint32_t pageNum, Latch mode) override;
+	void unlatchPage(uint32_t pageNum, Latch mode) override;
+	void markDirty(uint32_t pageNum) override;
+	void _flush(uint32_t pageNum) override;
+	void flushAll() override;
+	int _close() override;
+};
+
+#endif
@@ -1,20 +1,85 @@
 #include "node.hpp"
 #include <iostream>
+#include <cstring>
 
 uint32_t* leaf_node_num_cells(char* node) {
   return (uint32_t*)(node + LEAF_NODE_NUM_CELLS_OFFSET);
 }
 
+uint32_t* leaf_node_next_leaf(char* node) {
+  return (uint32_t*)(node + LEAF_NODE_NEXT_LEAF_OFFSET);
+}
+
+uint32_t* leaf_node_content_start(char* node) {
+  return (uint32_t*)(node + LEAF_NODE_CONTENT_START_OFFSET);
+}
+
+uint16_t* leaf_node_slot(char* node, uint32_t cell_num) {
+  return (uint16_t*)(node + LEAF_NODE_HEADER_SIZE + cell_num * LEAF_NODE_SLOT_SIZE);
+}
+
 char* leaf_node_cell(char* node, uint32_t cell_num) {
-  return node + LEAF_NODE_HEADER_SIZE + cell_num * LEAF_NODE_CELL_SIZE;
+  return node + *leaf_node_slot(node, cell_num);
 }
 
-uint32_t* leaf_node_key(char* node, uint32_t cell_num) {
-  return (uint32_t*)leaf_node_cell(node, cell_num);
+/**
+ * @brief the key of the cell, copied out: cells start at any byte
+ */
+uint32_t leaf_node_key(char* node, uint32_t cell_num) {
+  uint32_t key;
+  memcpy(&key, leaf_node_cell(node, cell_num), sizeof(key));
+  return key;
 }
 
 char* leaf_node_value(char* node, uint32_t cell_num) {
-  return leaf_node_cell(node, cell_num) + LEAF_NODE_KEY_SIZE;
+  return leaf_node_cell(node, cell_num);
+}
+
+/**
+ * @brief bytes between the slot array and the cell content
+ */
+uint32_t leaf_node_free_space(char* node) {
+  return *leaf_node_content_start(node) - LEAF_NODE_HEADER_SIZE -
+         *leaf_node_num_cells(node) * LEAF_NODE_SLOT_SIZE;
+}
+
+/**
+ * @brief put a record at position cell_num, moving the slots after it
+ * @return false if the leaf has no room for it
+ */
+bool leaf_node_insert_cell(char* node, uint32_t cell_num, const char* record, uint32_t size) {
+  if (leaf_node_free_space(node) < size + LEAF_NODE_SLOT_SIZE)
+    return false;
+
+  uint32_t numCells = *leaf_node_num_cells(node);
+  uint32_t offset = *leaf_node_content_start(node) - size;
+  memcpy(node + offset, record, size);
+  memmove(leaf_node_slot(node, cell_num + 1), leaf_node_slot(node, cell_num),
+          (numCells - cell_num) * LEAF_NODE_SLOT_SIZE);
+  *leaf_node_slot(node, cell_num) = offset;
+  *leaf_node_content_start(node) = offset;
+  *leaf_node_num_cells(node) = numCells + 1;
+  return true;
+}
+
+/**
+ * @brief remove the slot of cell_num and move the cells stored below
+ * it up by size, so the free space stays in one piece
+ */
+void leaf_node_remove_cell(char* node, uint32_t cell_num, uint32_t size) {
+  uint32_t numCells = *leaf_node_num_cells(node);
+  uint32_t offset = *leaf_node_slot(node, cell_num);
+  uint32_t start = *leaf_node_content_start(node);
+  memmove(node + start + size, node + start, offset - start);
+  memmove(leaf_node_slot(node, cell_num), leaf_node_slot(node, cell_num + 1),
+          (numCells - cell_num - 1) * LEAF_NODE_SLOT_SIZE);
+  *leaf_node_num_cells(node) = numCells - 1;
+  for (uint32_t i = 0; i < numCells - 1; ++i) {
+    if (*leaf_node_slot(node, i) < offset) {
+      *leaf_node_slot(node, i) += size;
+    }
+  }
+  *leaf_node_content_start(node) = start + size;
 }
 
 NodeType get_node_type(char *node) {
@@ -37,10 +102,16 @@ void set_node_root(char *node, bool is_root) {
 	*((uint8_t *)(node + IS_ROOT_OFFSET)) = value;
 }
 
+uint32_t *node_parent(char *node) {
+	return reinterpret_cast<uint32_t*>(node + PARENT_POINTER_OFFSET);
+}
+
 void initialize_leaf_node(char* node) {
 	set_node_type(node, NodeType::NodeLeaf);
 	set_node_root(node, false);
 	*leaf_node_num_cells(node) = 0;
+	*leaf_node_next_leaf(node) = 0;
+	*leaf_node_content_start(node) = PAGE_SIZE;
 }
 
 /**********************************************************************/
@@ -49,6 +120,7 @@ void initialize_internal_node(char *node) {
 	set_node_type(node, NodeType::NodeInternal);
 	set_node_root(node, false);
 	*internal_node_num_keys(node) = 0;
+	*internal_node_right_child(node) = INVALID_PAGE_NUM;
 }
 
 uint32_t *internal_node_num_keys(char *node) {
@@ -83,7 +155,28 @@ uint32_t *internal_node_child(char *node, uint32_t child_num) {
 }
 
 uint32_t *internal_node_key(char *node, uint32_t key_num) {
-    return internal_node_cell(node, key_num) + INTERNAL_NODE_CHILD_SIZE;
+    return reinterpret_cast<uint32_t*>(
+            reinterpret_cast<char*>(internal_node_cell(node, key_num)) + INTERNAL_NODE_CHILD_SIZE);
+}
+
+/**
+ * @brief index of the child that should contain key, binary search
+ * over the keys. Returns num_keys for the right child.
+ */
+uint32_t internal_node_find_child(char *node, uint32_t key) {
+	uint32_t minIndex = 0;
+	uint32_t maxIndex = *internal_node_num_keys(node);
+
+	while (minIndex != maxIndex) {
+		uint32_t index = (minIndex + maxIndex) / 2;
+		uint32_t keyToRight = *internal_node_key(node, index);
+		if (keyToRight >= key) {
+			maxIndex = index;
+		} else {
+			minIndex = index + 1;
+		}
+	}
+	return minIndex;
 }
 
 uint32_t get_node_max_key(char *node) {
@@ -91,9 +184,83 @@ uint32_t get_node_max_key(char *node) {
 	case NodeType::NodeInternal:
 		return *internal_node_key(node, *internal_node_num_keys(node) - 1);
 	case NodeType::NodeLeaf:
-		return *leaf_node_key(node, *leaf_node_num_cells(node) - 1);
+		return leaf_node_key(node, *leaf_node_num_cells(node) - 1);
   default:
     std::cout << "UNKNOWN - get_node_max_key";
     exit(EXIT_FAILURE);
 	}
-}
\ No newline at end of file
+}
+/**********************************************************************/
+
+uint32_t *index_internal_prefix_length(char *node) {
+	return reinterpret_cast<uint32_t*>(node + INDEX_INTERNAL_PREFIX_LENGTH_OFFSET);
+}
+
+char *index_internal_prefix(char *node) {
+	return node + INDEX_INTERNAL_HEADER_SIZE;
+}
+
+char *index_internal_slot(char *node, uint32_t slot_num) {
+	return index_internal_prefix(node) + *index_internal_prefix_length(node) +
+	       slot_num * INDEX_INTERNAL_SLOT_SIZE;
+}
+
+/**
+ * @brief child child_num of an index node, num_keys is the right child
+ */
+uint32_t *index_internal_child(char *node, uint32_t child_num) {
+	if (child_num == *internal_node_num_keys(node)) {
+		return internal_node_right_child(node);
+	}
+	return reinterpret_cast<uint32_t*>(index_internal_slot(node, child_num));
+}
+
+char *index_internal_separator(char *node, uint32_t key_num) {
+	uint16_t offset = *reinterpret_cast<uint16_t*>(index_internal_slot(node, key_num) + INTERNAL_NODE_CHILD_SIZE);
+	return node + offset;
+}
+
+/**********************************************************************/
+
+void initialize_meta_page(char *page, uint32_t rootPageNum) {
+	memset(page, 0, PAGE_SIZE);
+	*meta_magic(page) = META_MAGIC;
+	*meta_root_page(page) = rootPageNum;
+	*meta_version(page) = META_FORMAT_VERSION;
+}
+
+uint32_t *meta_magic(char *page) {
+	return reinterpret_cast<uint32_t*>(page + META_MAGIC_OFFSET);
+}
+
+uint32_t *meta_root_page(char *page) {
+	return reinterpret_cast<uint32_t*>(page + META_ROOT_PAGE_OFFSET);
+}
+
+uint32_t *meta_index_root(char *page, uint32_t column) {
+	return reinterpret_cast<uint32_t*>(page + META_INDEX_ROOTS_OFFSET) + column;
+}
+
+uint32_t *meta_version(char *page) {
+	return reinterpret_cast<uint32_t*>(page + META_VERSION_OFFSET);
+}
+
+uint32_t *meta_free_list(char *page) {
+	return reinterpret_cast<uint32_t*>(page + META_FREE_LIST_OFFSET);
+}
+
+uint32_t *meta_free_pages(char *page) {
+	return reinterpret_cast<uint32_t*>(page + META_FREE_PAGES_OFFSET);
+}
+
+uint32_t *free_trunk_next(char *page) {
+	return reinterpret_cast<uint32_t*>(page + FREE_TRUNK_NEXT_OFFSET);
+}
+
+uint32_t *free_trunk_count(char *page) {
+	return reinterpret_cast<uint32_t*>(page + FREE_TRUNK_COUNT_OFFSET);
+}
+
+uint32_t *free_trunk_page(char *page, uint32_t i) {
+	return reinterpret_cast<uint32_t*>(page + FREE_TRUNK_HEADER_SIZE) + i;
+}
@@ -32,39 +32,63 @@ void set_node_type(char *node, NodeType type);
 bool is_node_root(char *node);
 void set_node_root(char *node, bool is_root);
 
+uint32_t *node_parent(char *node);
+
 /**
  * Leaf Node Header Layout
  */
 constexpr uint32_t LEAF_NODE_NUM_CELLS_SIZE = sizeof(uint32_t);
 constexpr uint32_t LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
+//page of the leaf holding the next keys, 0 for the last leaf
+//(page 0 is the meta page and never a sibling)
+constexpr uint32_t LEAF_NODE_NEXT_LEAF_SIZE = sizeof(uint32_t);
+constexpr uint32_t LEAF_NODE_NEXT_LEAF_OFFSET =
+    LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE;
+//start of the cell content area, it grows down from the end of the page
+constexpr uint32_t LEAF_NODE_CONTENT_START_SIZE = sizeof(uint32_t);
+constexpr uint32_t LEAF_NODE_CONTENT_START_OFFSET =
+    LEAF_NODE_NEXT_LEAF_OFFSET + LEAF_NODE_NEXT_LEAF_SIZE;
 constexpr uint32_t LEAF_NODE_HEADER_SIZE =
-    COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE;
+    LEAF_NODE_CONTENT_START_OFFSET + LEAF_NODE_CONTENT_START_SIZE;
 
 /*
  * Leaf Node Body Layout
+ * Slotted page: after the header comes an array with the offset
+ * of every cell in key order, growing up, and the cells fill the
+ * page from its end, growing down. A cell is the record of a row
+ * and starts with its key, the id.
  */
 constexpr uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t);
-constexpr uint32_t LEAF_NODE_KEY_OFFSET = 0;
-constexpr uint32_t LEAF_NODE_VALUE_SIZE = Row::ROW_SIZE;
-constexpr uint32_t LEAF_NODE_VALUE_OFFSET =
-    LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
-constexpr uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
+constexpr uint32_t LEAF_NODE_SLOT_SIZE = sizeof(uint16_t);
 constexpr uint32_t LEAF_NODE_SPACE_FOR_CELLS = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-constexpr uint32_t LEAF_NODE_MAX_CELLS =
-    LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE;
-
-constexpr uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
-constexpr uint32_t LEAF_NODE_LEFT_SPLIT_COUNT =
-    (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
 
 uint32_t* leaf_node_num_cells(char* node);
 
+uint32_t* leaf_node_next_leaf(char* node);
+
+uint32_t* leaf_node_content_start(char* node);
+
+uint16_t* leaf_node_slot(char* node, uint32_t cell_num);
+
 char* leaf_node_cell(char* node, uint32_t cell_num);
 
-uint32_t* leaf_node_key(char* node, uint32_t cell_num);
+uint32_t leaf_node_key(char* node, uint32_t cell_num);
 
+//the record of the cell
 char* leaf_node_value(char* node, uint32_t cell_num);
 
+uint32_t leaf_node_free_space(char* node);
+
+bool leaf_node_insert_cell(char* node, uint32_t cell_num, const char* record, uint32_t size);
+
+//take out the cell of size bytes at cell_num, the content area closes the gap
+void leaf_node_remove_cell(char* node, uint32_t cell_num, uint32_t size);
+
+//bytes taken by the cells and their slots
+inline uint32_t leaf_node_used_space(char* node) {
+  return LEAF_NODE_SPACE_FOR_CELLS - leaf_node_free_space(node);
+}
+
 void initialize_leaf_node(char* node);
 
 /************************
@@ -82,10 +106,17 @@ constexpr uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE +
                                            INTERNAL_NODE_RIGHT_CHILD_SIZE;
 
 //BODY
+//key i is the largest key that may live under child i,
+//keys above the last one live under the right child
 constexpr uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
 constexpr uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
 constexpr uint32_t INTERNAL_NODE_CELL_SIZE =
     INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
+constexpr uint32_t INTERNAL_NODE_SPACE_FOR_CELLS = PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE;
+constexpr uint32_t INTERNAL_NODE_MAX_KEYS =
+    INTERNAL_NODE_SPACE_FOR_CELLS / INTERNAL_NODE_CELL_SIZE;
+
+constexpr uint32_t INVALID_PAGE_NUM = UINT32_MAX;
 
 void initialize_internal_node(char *node);
 uint32_t *internal_node_num_keys(char *node);
@@ -93,5 +124,89 @@ uint32_t *internal_node_right_child(char *node);
 uint32_t *internal_node_cell(char *node, uint32_t cell_num);
 uint32_t *internal_node_child(char *node, uint32_t child_num);
 uint32_t *internal_node_key(char *node, uint32_t key_num);
+uint32_t internal_node_find_child(char *node, uint32_t key);
 uint32_t get_node_max_key(char* node);
+
+/************************
+ * INDEX NODE
+ * Index leaves are slotted pages like table leaves, their cells
+ * hold an entry: a length byte, the column value and the id of
+ * the row. Entries are ordered by value, then id, which makes
+ * them unique even when values repeat.
+ *
+ * Index internal nodes keep the internal header, followed by the
+ * prefix all separators of the node share, stored once. Then
+ * comes a slot per separator with its child and the offset of
+ * the rest of the separator: a length byte, the value without
+ * the prefix and the id. Separators are the shortest values
+ * between their children, not full entries.
+ ***********************/
+constexpr uint32_t INDEX_ID_SIZE = sizeof(uint32_t);
+constexpr uint32_t INDEX_LENGTH_SIZE = sizeof(uint8_t);
+constexpr uint32_t INDEX_MAX_ENTRY_SIZE = INDEX_LENGTH_SIZE + Row::EMAIL_SIZE + INDEX_ID_SIZE;
+
+constexpr uint32_t INDEX_INTERNAL_PREFIX_LENGTH_SIZE = sizeof(uint32_t);
+constexpr uint32_t INDEX_INTERNAL_PREFIX_LENGTH_OFFSET = INTERNAL_NODE_HEADER_SIZE;
+constexpr uint32_t INDEX_INTERNAL_HEADER_SIZE =
+    INDEX_INTERNAL_PREFIX_LENGTH_OFFSET + INDEX_INTERNAL_PREFIX_LENGTH_SIZE;
+constexpr uint32_t INDEX_INTERNAL_SLOT_OFFSET_SIZE = sizeof(uint16_t);
+constexpr uint32_t INDEX_INTERNAL_SLOT_SIZE = INTERNAL_NODE_CHILD_SIZE + INDEX_INTERNAL_SLOT_OFFSET_SIZE;
+
+uint32_t *index_internal_prefix_length(char *node);
+char *index_internal_prefix(char *node);
+char *index_internal_slot(char *node, uint32_t slot_num);
+uint32_t *index_internal_child(char *node, uint32_t child_num);
+//length byte of separator key_num, its suffix and id follow
+char *index_internal_separator(char *node, uint32_t key_num);
+
+/************************
+ * META PAGE
+ * Page 0 describes the file: the page of the table's root
+ * and the root page of every index, 0 if the column has none.
+ ***********************/
+constexpr uint32_t META_MAGIC = 0x314c5153;
+constexpr uint32_t META_PAGE_NUM = 0;
+constexpr uint32_t NUM_INDEX_COLUMNS = 2;
+constexpr uint32_t META_MAGIC_SIZE = sizeof(uint32_t);
+constexpr uint32_t META_MAGIC_OFFSET = 0;
+constexpr uint32_t META_ROOT_PAGE_SIZE = sizeof(uint32_t);
+constexpr uint32_t META_ROOT_PAGE_OFFSET = META_MAGIC_OFFSET + META_MAGIC_SIZE;
+constexpr uint32_t META_INDEX_ROOTS_OFFSET = META_ROOT_PAGE_OFFSET + META_ROOT_PAGE_SIZE;
+constexpr uint32_t META_INDEX_ROOTS_SIZE = NUM_INDEX_COLUMNS * sizeof(uint32_t);
+//layout of the table leaves: 0 fixed size cells, 1 slotted pages
+//2 index nodes with variable length entries
+constexpr uint32_t META_FORMAT_VERSION = 2;
+constexpr uint32_t META_VERSION_SIZE = sizeof(uint32_t);
+constexpr uint32_t META_VERSION_OFFSET = META_INDEX_ROOTS_OFFSET + META_INDEX_ROOTS_SIZE;
+
+void initialize_meta_page(char *page, uint32_t rootPageNum);
+uint32_t *meta_magic(char *page);
+uint32_t *meta_root_page(char *page);
+uint32_t *meta_index_root(char *page, uint32_t column);
+uint32_t *meta_version(char *page);
+
+/************************
+ * FREE LIST
+ * Pages the tree gave up, reused before the file grows. The
+ * meta page holds the first trunk page of the list and the
+ * number of free pages, 0 for none. A trunk page holds the
+ * next trunk page, a count and that many free page numbers.
+ * The trunk pages are free pages too: a trunk whose numbers
+ * are all handed out is handed out itself.
+ ***********************/
+constexpr uint32_t META_FREE_LIST_SIZE = sizeof(uint32_t);
+constexpr uint32_t META_FREE_LIST_OFFSET = META_VERSION_OFFSET + META_VERSION_SIZE;
+constexpr uint32_t META_FREE_PAGES_SIZE = sizeof(uint32_t);
+constexpr uint32_t META_FREE_PAGES_OFFSET = META_FREE_LIST_OFFSET + META_FREE_LIST_SIZE;
+
+constexpr uint32_t FREE_TRUNK_NEXT_OFFSET = 0;
+constexpr uint32_t FREE_TRUNK_COUNT_OFFSET = FREE_TRUNK_NEXT_OFFSET + sizeof(uint32_t);
+constexpr uint32_t FREE_TRUNK_HEADER_SIZE = FREE_TRUNK_COUNT_OFFSET + sizeof(uint32_t);
+constexpr uint32_t FREE_TRUNK_MAX_PAGES = (PAGE_SIZE - FREE_TRUNK_HEADER_SIZE) / sizeof(uint32_t);
+
+uint32_t *meta_free_list(char *page);
+uint32_t *meta_free_pages(char *page);
+uint32_t *free_trunk_next(char *page);
+uint32_t *free_trunk_count(char *page);
+uint32_t *free_trunk_page(char *page, uint32_t i);
 #endif
\ No newline at end of file
@@ -1,98 +1,771 @@
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <climits>
 
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "pager.hpp"
+#include "node.hpp"
+#include "stats.hpp"
 
-Pager::Pager() noexcept {
-    for (int i = 0; i < MAX_PAGES; ++i) {
-        pages[i] = nullptr;
-    }
+Pager::Pager(const PagerOptions &options) noexcept {
+    maxFrames = options.maxFrames < MIN_POOL_FRAMES ? MIN_POOL_FRAMES : options.maxFrames;
+    pageTable.reserve(maxFrames);
+    slab = nullptr;
+    slabLength = 0;
+    clockHand = 0;
     fileLength = 0;
+    numOfPages = 0;
+    walOptions = options.wal;
+    wal = nullptr;
+    logHasUncommitted = false;
+    compressed = nullptr;
+    compressNewFile = options.compress;
+    direct = options.direct;
+    stopFlusher = false;
+    flushIntervalMs = options.flushIntervalMs;
+    flushBatchPages = options.flushBatchPages > 0 ? options.flushBatchPages : 1;
+    flushCursor = 0;
+    //read-ahead fills the page cache, which direct reads skip
+    readAheadPages = options.direct ? 0 : options.readAheadPages;
+    lastMissPage = UINT32_MAX;
+    sequentialMisses = 0;
+    readAheadEnd = 0;
+    stopPrefetcher = false;
 }
 
 Pager::~Pager() {
-    for (int i = 0; i < MAX_PAGES; ++i) {
-        if (pages[i]) {
-            delete[] pages[i];
-            pages[i] = nullptr;
-        }
+    stopFlushing();
+    stopPrefetching();
+    for (Frame &f : frames) {
+        f.data = nullptr;
+    }
+    if (slab) {
+        munmap(slab, slabLength);
     }
+    delete wal;
+    delete compressed;
 }
 
 void Pager::_open(std::string filename) {
 	fileDescriptor = open(filename.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
 	if (fileDescriptor == -1) {
 		std::cout << "Unable to open file\n";
+		exit(EXIT_FAILURE);
 	}
 
-	fileLength = lseek(fileDescriptor, 0, SEEK_END);
-	numOfPages = fileLength / PAGE_SIZE;
+	bool isNew = lseek(fileDescriptor, 0, SEEK_END) == 0;
+	if (CompressedFile::isCompressed(fileDescriptor) || (isNew && compressNewFile)) {
+		if (walOptions.enabled || access((filename + "-wal").c_str(), F_OK) == 0) {
+			std::cout << "The write-ahead log can't be used with a compressed database.\n";
+			exit(EXIT_FAILURE);
+		}
+		compressed = new CompressedFile(fileDescriptor);
+		compressed->_open();
+		//pages, not bytes, the images are read through compressed
+		numOfPages = compressed->getNumOfPages();
+		fileLength = (uint64_t)numOfPages * PAGE_SIZE;
+	} else {
+		replayWal(filename);
 
-	if (fileLength % PAGE_SIZE != 0) {
-		std::cout << "DB file is corrupt!\n";
+		fileLength = lseek(fileDescriptor, 0, SEEK_END);
+		numOfPages = fileLength / PAGE_SIZE;
+
+		if (fileLength % PAGE_SIZE != 0) {
+			std::cout << "DB file is corrupt!\n";
+		}
+	}
+
+	//set only now, the format check and the log recovery read and write unaligned
+	if (direct) {
+		if (compressed) {
+			std::cout << "Direct I/O can't be used with a compressed database.\n";
+			exit(EXIT_FAILURE);
+		}
+		int flags = fcntl(fileDescriptor, F_GETFL);
+		if (flags == -1 || fcntl(fileDescriptor, F_SETFL, flags | O_DIRECT) == -1) {
+			std::cout << "Direct I/O isn't supported for this file.\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (flushIntervalMs > 0) {
+		flusher = std::thread(&Pager::flushLoop, this);
+	}
+	if (readAheadPages > 0) {
+		prefetcher = std::thread(&Pager::prefetchLoop, this);
 	}
 }
 
 /**
- * @brief returns the page at pageNum
+ * @brief recover the write-ahead log of filename into the database file
+ * @details Runs even with the log disabled, so a log left behind by a
+ * crashed session is never lost. With the log enabled it stays open.
  */
-char *Pager::getPage(uint32_t pageNum) {
-	if (pageNum > MAX_PAGES) {
-		std::cout << "This page number is out of bounds.\n";
+void Pager::replayWal(const std::string &filename) {
+	std::string walPath = filename + "-wal";
+	if (!walOptions.enabled && access(walPath.c_str(), F_OK) != 0)
+		return;
+
+	wal = new Wal(walPath, walOptions);
+	wal->_open();
+	if (wal->getNumOfFrames() > 0) {
+		wal->checkpoint(fileDescriptor);
+	}
+
+	if (!walOptions.enabled) {
+		wal->_close(true);
+		delete wal;
+		wal = nullptr;
+	}
+}
+
+/**
+ * @brief move the committed frames of the log into the database file
+ * @details Call with poolMutex held.
+ */
+void Pager::checkpointWal() {
+	uint64_t length = (uint64_t)wal->checkpoint(fileDescriptor) * PAGE_SIZE;
+	if (length > fileLength) {
+		fileLength = length;
+	}
+}
+
+/**
+ * @brief pick an unpinned frame to reuse (CLOCK)
+ * @details Sweeps the frames, giving every referenced frame a second
+ * chance. Two full sweeps without a victim means every frame is pinned.
+ */
+uint32_t Pager::findVictim() {
+	for (uint32_t i = 0; i < 2 * frames.size(); ++i) {
+		Frame &f = frames[clockHand];
+		uint32_t index = clockHand;
+		clockHand = (clockHand + 1) % frames.size();
+
+		if (f.pinCount > 0)
+			continue;
+		if (f.referenced) {
+			f.referenced = false;
+			continue;
+		}
+		return index;
+	}
+
+	std::cout << "Buffer pool exhausted, all frames are pinned.\n";
+	exit(EXIT_FAILURE);
+}
+
+void Pager::writeFrame(Frame &frame) {
+	if (compressed) {
+		compressed->writePage(frame.pageNum, frame.data);
+		if ((uint64_t)(frame.pageNum + 1) * PAGE_SIZE > fileLength) {
+			fileLength = (uint64_t)(frame.pageNum + 1) * PAGE_SIZE;
+		}
+		frame.dirty = false;
+		return;
+	}
+
+	ssize_t numOfBytesWritten = pwrite(fileDescriptor, frame.data, PAGE_SIZE, (off_t)frame.pageNum * PAGE_SIZE);
+	if (numOfBytesWritten != PAGE_SIZE) {
+		std::cout << "Error writing to file. Exiting...\n";
 		exit(EXIT_FAILURE);
 	}
+	stat_add(stats.bytesWritten, numOfBytesWritten);
+
+	if ((uint64_t)(frame.pageNum + 1) * PAGE_SIZE > fileLength) {
+		fileLength = (uint64_t)(frame.pageNum + 1) * PAGE_SIZE;
+	}
+	frame.dirty = false;
+}
+
+/**
+ * @brief write frames to their pages, one pwritev per run of adjacent pages
+ * @param batch frame indices sorted by page number
+ */
+void Pager::writeRuns(const std::vector<uint32_t> &batch) {
+	if (compressed) {
+		//images of adjacent pages aren't adjacent in a compressed file
+		for (uint32_t i : batch) {
+			compressed->writePage(frames[i].pageNum, frames[i].data);
+		}
+		return;
+	}
+
+	std::vector<struct iovec> iov;
+	iov.reserve(batch.size());
+
+	size_t start = 0;
+	while (start < batch.size()) {
+		size_t end = start + 1;
+		//one call takes at most IOV_MAX buffers
+		while (end < batch.size() && end - start < IOV_MAX &&
+		       frames[batch[end]].pageNum == frames[batch[end - 1]].pageNum + 1) {
+			end++;
+		}
+
+		iov.clear();
+		for (size_t i = start; i < end; ++i) {
+			iov.push_back({frames[batch[i]].data, PAGE_SIZE});
+		}
+		off_t offset = (off_t)frames[batch[start]].pageNum * PAGE_SIZE;
+		ssize_t expected = (end - start) * PAGE_SIZE;
+		if (pwritev(fileDescriptor, iov.data(), iov.size(), offset) != expected) {
+			std::cout << "Error writing to file. Exiting...\n";
+			exit(EXIT_FAILURE);
+		}
+		stat_add(stats.bytesWritten, expected);
+		start = end;
+	}
+}
 
-	if (pages[pageNum] == nullptr) {
-		char *page = new char[PAGE_SIZE];
-		uint32_t numOfPages_ = fileLength / PAGE_SIZE;
+/**
+ * @brief background flusher, writes a batch of dirty frames per interval
+ * @details The batch is pinned and latched shared while it is written
+ * without the lock held, so eviction can't reuse those frames and
+ * writers can't change them under the write.
+ */
+void Pager::flushLoop() {
+	std::unique_lock<std::shared_mutex> lock(poolMutex);
+	while (!stopFlusher) {
+		flushCond.wait_for(lock, std::chrono::milliseconds(flushIntervalMs));
+		if (stopFlusher)
+			break;
 
-		//incomplete page
-		if(fileLength % PAGE_SIZE) {
-			numOfPages_ += 1;
+		if (wal) {
+			if (!logHasUncommitted && wal->getNumOfFrames() >= walOptions.checkpointFrames) {
+				checkpointWal();
+			}
+			continue;
 		}
 
-		if (pageNum <= numOfPages_) {
-			lseek(fileDescriptor, pageNum * PAGE_SIZE, SEEK_SET);
-			ssize_t numOfBytesRead = read(fileDescriptor, page, PAGE_SIZE);
-			if (numOfBytesRead == -1) {
-				std::cout << "Error reading file\n";
-				exit(EXIT_FAILURE);
+		std::vector<uint32_t> batch;
+		for (uint32_t i = 0; i < frames.size(); ++i) {
+			if (frames[i].dirty && frames[i].pinCount == 0) {
+				batch.push_back(i);
 			}
 		}
-		pages[pageNum] = page;
-		if (pageNum >= numOfPages) {
-			this->numOfPages = pageNum + 1;
+		if (batch.empty())
+			continue;
+
+		//continue the sweep where the last batch stopped, wrapping around
+		std::sort(batch.begin(), batch.end(), [this](uint32_t a, uint32_t b) {
+			bool aWrapped = frames[a].pageNum < flushCursor;
+			bool bWrapped = frames[b].pageNum < flushCursor;
+			if (aWrapped != bWrapped)
+				return bWrapped;
+			return frames[a].pageNum < frames[b].pageNum;
+		});
+		if (batch.size() > flushBatchPages) {
+			batch.resize(flushBatchPages);
+		}
+		std::sort(batch.begin(), batch.end(), [this](uint32_t a, uint32_t b) {
+			return frames[a].pageNum < frames[b].pageNum;
+		});
+
+		//unpinned frames have no latch holders, so the shared latches are
+		//free and keep a writer from changing the pages mid write
+		uint32_t lastPage = 0;
+		for (uint32_t i : batch) {
+			frames[i].pinCount++;
+			frames[i].latch.lock_shared();
+			frames[i].dirty = false;
+			lastPage = std::max(lastPage, frames[i].pageNum);
+		}
+		flushCursor = lastPage + 1;
+
+		lock.unlock();
+		writeRuns(batch);
+		stat_add(stats.flushes);
+		lock.lock();
+
+		for (uint32_t i : batch) {
+			frames[i].latch.unlock_shared();
+			frames[i].pinCount--;
+		}
+		if ((uint64_t)(lastPage + 1) * PAGE_SIZE > fileLength) {
+			fileLength = (uint64_t)(lastPage + 1) * PAGE_SIZE;
+		}
+	}
+}
+
+void Pager::stopFlushing() {
+	if (!flusher.joinable())
+		return;
+
+	{
+		std::lock_guard<std::shared_mutex> lock(poolMutex);
+		stopFlusher = true;
+	}
+	flushCond.notify_one();
+	flusher.join();
+}
+
+/**
+ * @brief start read-ahead once misses come in ascending page order
+ * @details Keeps up to readAheadPages pages past the miss requested,
+ * topping the window up when the scan got through half of it.
+ * Call with poolMutex held.
+ */
+void Pager::noteMiss(uint32_t pageNum) {
+	if (!prefetcher.joinable())
+		return;
+
+	if (pageNum > lastMissPage && pageNum - lastMissPage <= SEQUENTIAL_MISS_GAP) {
+		sequentialMisses++;
+	} else {
+		sequentialMisses = 0;
+		readAheadEnd = 0;
+	}
+	lastMissPage = pageNum;
+	if (sequentialMisses < SEQUENTIAL_MISS_RUN || readAheadEnd > pageNum + readAheadPages / 2)
+		return;
+
+	uint32_t first = std::max(readAheadEnd, pageNum + 1);
+	uint32_t end = std::min<uint64_t>((uint64_t)pageNum + 1 + readAheadPages, fileLength / PAGE_SIZE);
+	if (first >= end)
+		return;
+	readAheadEnd = end;
+
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		prefetchQueue.push_back({first, end - first});
+	}
+	prefetchCond.notify_one();
+}
+
+/**
+ * @brief have the prefetcher read pageNum unless the pool holds it,
+ * for accesses whose order misses don't give away
+ */
+void Pager::prefetchPage(uint32_t pageNum) {
+	if (!prefetcher.joinable())
+		return;
+	{
+		std::shared_lock<std::shared_mutex> lock(poolMutex);
+		if (pageTable.count(pageNum) > 0 || (uint64_t)pageNum * PAGE_SIZE >= fileLength)
+			return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		prefetchQueue.push_back({pageNum, 1});
+	}
+	prefetchCond.notify_one();
+}
+
+/**
+ * @brief prefetcher thread, hands queued page ranges to the kernel
+ * @details posix_fadvise only starts the reads, the pages land in the
+ * page cache while the scan works on the pages it already has.
+ */
+void Pager::prefetchLoop() {
+	std::unique_lock<std::mutex> lock(prefetchMutex);
+	while (true) {
+		prefetchCond.wait(lock, [this] { return stopPrefetcher || !prefetchQueue.empty(); });
+		if (stopPrefetcher)
+			break;
+
+		std::pair<uint32_t, uint32_t> range = prefetchQueue.front();
+		prefetchQueue.pop_front();
+		lock.unlock();
+		if (compressed) {
+			compressed->prefetch(range.first, range.second);
+		} else {
+			posix_fadvise(fileDescriptor, (off_t)range.first * PAGE_SIZE, (off_t)range.second * PAGE_SIZE,
+			              POSIX_FADV_WILLNEED);
+		}
+		lock.lock();
+	}
+}
+
+void Pager::stopPrefetching() {
+	if (!prefetcher.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		stopPrefetcher = true;
+	}
+	prefetchCond.notify_one();
+	prefetcher.join();
+}
+
+/**
+ * @brief reserve the memory of all frames, aligned for huge pages
+ * @details Only address space is taken here, a frame gets memory once
+ * it is first used. Over-reserving and unmapping the ends gives the
+ * alignment. Huge pages are a hint, without them the slab still keeps
+ * the frames next to each other.
+ */
+void Pager::mapSlab() {
+	slabLength = ((size_t)maxFrames * PAGE_SIZE + POOL_SLAB_ALIGNMENT - 1) & ~(POOL_SLAB_ALIGNMENT - 1);
+	size_t reserved = slabLength + POOL_SLAB_ALIGNMENT;
+	void *mapped = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapped == MAP_FAILED) {
+		std::cout << "Unable to allocate the buffer pool. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+
+	uintptr_t start = (uintptr_t)mapped;
+	uintptr_t aligned = (start + POOL_SLAB_ALIGNMENT - 1) & ~(uintptr_t)(POOL_SLAB_ALIGNMENT - 1);
+	if (aligned > start) {
+		munmap(mapped, aligned - start);
+	}
+	if (start + reserved > aligned + slabLength) {
+		munmap((char *)(aligned + slabLength), start + reserved - aligned - slabLength);
+	}
+	slab = (char *)aligned;
+	madvise(slab, slabLength, MADV_HUGEPAGE);
+}
+
+/**
+ * @brief returns the frame holding pageNum, loading it on a miss
+ * @details Call with poolMutex held.
+ */
+uint32_t Pager::getFrame(uint32_t pageNum) {
+	auto it = pageTable.find(pageNum);
+	if (it != pageTable.end()) {
+		frames[it->second].referenced = true;
+		stat_add(stats.pageHits);
+		return it->second;
+	}
+	stat_add(stats.pageMisses);
+
+	uint32_t index;
+	if (frames.size() < maxFrames) {
+		if (!slab) {
+			mapSlab();
+		}
+		index = frames.size();
+		frames.emplace_back(slab + (size_t)index * PAGE_SIZE);
+	} else {
+		index = findVictim();
+		Frame &victim = frames[index];
+		if (victim.dirty && wal) {
+			wal->appendFrames({{victim.pageNum, victim.data}}, 0);
+			victim.dirty = false;
+			logHasUncommitted = true;
+		} else if (victim.dirty) {
+			writeFrame(victim);
+		}
+		pageTable.erase(victim.pageNum);
+	}
+
+	Frame &f = frames[index];
+	f.pageNum = pageNum;
+	f.pinCount = 0;
+	f.dirty = false;
+	f.referenced = true;
+
+	uint32_t numOfPagesOnDisk = fileLength / PAGE_SIZE;
+	if (wal && wal->readPage(pageNum, f.data)) {
+		//newest image of the page is in the log
+	} else if (compressed) {
+		noteMiss(pageNum);
+		if (!compressed->readPage(pageNum, f.data)) {
+			memset(f.data, 0, PAGE_SIZE);
+		}
+	} else if (pageNum < numOfPagesOnDisk) {
+		noteMiss(pageNum);
+		ssize_t numOfBytesRead = pread(fileDescriptor, f.data, PAGE_SIZE, (off_t)pageNum * PAGE_SIZE);
+		if (numOfBytesRead == -1) {
+			std::cout << "Error reading file\n";
+			exit(EXIT_FAILURE);
+		}
+		stat_add(stats.bytesRead, numOfBytesRead);
+	} else {
+		//page was never written, start from a blank page
+		memset(f.data, 0, PAGE_SIZE);
+	}
+
+	pageTable[pageNum] = index;
+	if (pageNum >= numOfPages) {
+		numOfPages = pageNum + 1;
+	}
+	return index;
+}
+
+/**
+ * @brief returns the page at pageNum
+ */
+char *Pager::getPage(uint32_t pageNum) {
+	{
+		std::shared_lock<std::shared_mutex> lock(poolMutex);
+		auto it = pageTable.find(pageNum);
+		if (it != pageTable.end()) {
+			Frame &f = frames[it->second];
+			f.referenced.store(true, std::memory_order_relaxed);
+			stat_add(stats.pageHits);
+			return f.data;
+		}
+	}
+	std::lock_guard<std::shared_mutex> lock(poolMutex);
+	return frames[getFrame(pageNum)].data;
+}
+
+/**
+ * @brief pin the frame of pageNum, a hit only needs the shared lock
+ */
+Frame &Pager::pinFrame(uint32_t pageNum) {
+	{
+		std::shared_lock<std::shared_mutex> lock(poolMutex);
+		auto it = pageTable.find(pageNum);
+		if (it != pageTable.end()) {
+			Frame &f = frames[it->second];
+			f.pinCount.fetch_add(1, std::memory_order_relaxed);
+			f.referenced.store(true, std::memory_order_relaxed);
+			stat_add(stats.pageHits);
+			return f;
+		}
+	}
+	std::lock_guard<std::shared_mutex> lock(poolMutex);
+	Frame &f = frames[getFrame(pageNum)];
+	f.pinCount++;
+	return f;
+}
+
+/**
+ * @brief returns the page at pageNum and keeps it resident
+ * until the matching unpinPage()
+ */
+char *Pager::pinPage(uint32_t pageNum) {
+	return pinFrame(pageNum).data;
+}
+
+void Pager::unpinPage(uint32_t pageNum) {
+	std::shared_lock<std::shared_mutex> lock(poolMutex);
+	auto it = pageTable.find(pageNum);
+	if (it == pageTable.end() || frames[it->second].pinCount == 0) {
+		std::cout << "Tried to unpin page " << pageNum << " which is not pinned.\n";
+		exit(EXIT_FAILURE);
+	}
+	frames[it->second].pinCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief pin pageNum and take its latch in mode
+ * @details The page stays resident and its content doesn't change under
+ * a shared latch until unlatchPage(). Waiting for the latch happens
+ * without the pool lock, the pin keeps the frame from being reused.
+ */
+char *Pager::latchPage(uint32_t pageNum, Latch mode) {
+	Frame &f = pinFrame(pageNum);
+	if (mode == Latch::Shared) {
+		f.latch.lock_shared();
+	} else {
+		f.latch.lock();
+	}
+	return f.data;
+}
+
+void Pager::unlatchPage(uint32_t pageNum, Latch mode) {
+	Frame *f;
+	{
+		std::shared_lock<std::shared_mutex> lock(poolMutex);
+		auto it = pageTable.find(pageNum);
+		if (it == pageTable.end() || frames[it->second].pinCount == 0) {
+			std::cout << "Tried to unlatch page " << pageNum << " which is not latched.\n";
+			exit(EXIT_FAILURE);
 		}
+		f = &frames[it->second];
 	}
-	return pages[pageNum];
+
+	if (mode == Latch::Shared) {
+		f->latch.unlock_shared();
+	} else {
+		f->latch.unlock();
+	}
+	f->pinCount.fetch_sub(1, std::memory_order_relaxed);
 }
 
+/**
+ * @brief record that pageNum was modified and has to be
+ * written back before its frame is reused
+ */
+void Pager::markDirty(uint32_t pageNum) {
+	std::lock_guard<std::shared_mutex> lock(poolMutex);
+	frames[getFrame(pageNum)].dirty = true;
+}
+
+/**
+ * @brief a page for a new node: one off the free list, else the
+ * page past the end of the file
+ * @details A page from the free list is taken off it right away, the
+ * end of the file only moves once the page is accessed. Called by the
+ * one writer.
+ */
 uint32_t Pager::getUnusedPageNum() {
-	return numOfPages;
+	char *meta = pinPage(META_PAGE_NUM);
+	uint32_t trunkPageNum = *meta_free_list(meta);
+	if (trunkPageNum == 0) {
+		unpinPage(META_PAGE_NUM);
+		std::shared_lock<std::shared_mutex> lock(poolMutex);
+		return numOfPages;
+	}
+
+	char *trunk = pinPage(trunkPageNum);
+	uint32_t count = *free_trunk_count(trunk);
+	uint32_t pageNum;
+	if (count > 0) {
+		pageNum = *free_trunk_page(trunk, count - 1);
+		*free_trunk_count(trunk) = count - 1;
+		markDirty(trunkPageNum);
+	} else {
+		pageNum = trunkPageNum;
+		*meta_free_list(meta) = *free_trunk_next(trunk);
+	}
+	*meta_free_pages(meta) -= 1;
+	markDirty(META_PAGE_NUM);
+	unpinPage(trunkPageNum);
+	unpinPage(META_PAGE_NUM);
+	return pageNum;
+}
+
+/**
+ * @brief put pageNum on the free list, nothing may point to it any more
+ * @details The number goes into the first trunk page, a free page
+ * becomes the new first trunk once that one is full.
+ */
+void Pager::freePage(uint32_t pageNum) {
+	char *meta = pinPage(META_PAGE_NUM);
+	uint32_t trunkPageNum = *meta_free_list(meta);
+	bool added = false;
+	if (trunkPageNum != 0) {
+		char *trunk = pinPage(trunkPageNum);
+		uint32_t count = *free_trunk_count(trunk);
+		if (count < FREE_TRUNK_MAX_PAGES) {
+			*free_trunk_page(trunk, count) = pageNum;
+			*free_trunk_count(trunk) = count + 1;
+			markDirty(trunkPageNum);
+			added = true;
+		}
+		unpinPage(trunkPageNum);
+	}
+	if (!added) {
+		char *page = pinPage(pageNum);
+		memset(page, 0, PAGE_SIZE);
+		*free_trunk_next(page) = trunkPageNum;
+		markDirty(pageNum);
+		unpinPage(pageNum);
+		*meta_free_list(meta) = pageNum;
+	}
+	*meta_free_pages(meta) += 1;
+	markDirty(META_PAGE_NUM);
+	unpinPage(META_PAGE_NUM);
 }
 
 void Pager::_flush(uint32_t pageNum) {
-	if (pages[pageNum] == nullptr) {
+	stat_add(stats.flushes);
+	std::lock_guard<std::shared_mutex> lock(poolMutex);
+	auto it = pageTable.find(pageNum);
+	if (it == pageTable.end()) {
 		std::cout << "Tried to flush null page. Exiting..." << std::endl;
 		exit(EXIT_FAILURE);
 	}
 
-	off_t offset = lseek(fileDescriptor, pageNum * PAGE_SIZE, SEEK_SET);
-	if (offset == -1) {
-		std::cout << "Error seeking file. Exiting... \n";
-		exit(EXIT_FAILURE);
+	if (wal) {
+		//the page must not reach the file before it is committed
+		commitLocked();
+		return;
 	}
+	writeFrame(frames[it->second]);
+}
 
-	ssize_t numOfBytesWritten = write(fileDescriptor, pages[pageNum], PAGE_SIZE);
-	if (numOfBytesWritten == -1) {
-		std::cout << "Error writing to file. Exiting...\n";
-		exit(EXIT_FAILURE);
+/**
+ * @brief write back every dirty frame in the pool, and nothing else
+ */
+void Pager::flushAll() {
+	stat_add(stats.flushes);
+	std::lock_guard<std::shared_mutex> lock(poolMutex);
+	if (wal) {
+		commitLocked();
+		checkpointWal();
+		return;
+	}
+
+	std::vector<uint32_t> batch;
+	for (uint32_t i = 0; i < frames.size(); ++i) {
+		if (frames[i].dirty) {
+			batch.push_back(i);
+		}
+	}
+	std::sort(batch.begin(), batch.end(), [this](uint32_t a, uint32_t b) {
+		return frames[a].pageNum < frames[b].pageNum;
+	});
+
+	writeRuns(batch);
+	for (uint32_t i : batch) {
+		frames[i].dirty = false;
+		if ((uint64_t)(frames[i].pageNum + 1) * PAGE_SIZE > fileLength) {
+			fileLength = (uint64_t)(frames[i].pageNum + 1) * PAGE_SIZE;
+		}
+	}
+	if (compressed) {
+		compressed->sync();
+	}
+}
+
+/**
+ * @brief make all changes so far one atomic unit in the log
+ * @details Appends every dirty frame to the log with one write, the
+ * last frame marking the commit. Durability follows the group commit
+ * settings of the log. Without a log this does nothing, changes reach
+ * the file on eviction and on flushAll().
+ */
+void Pager::commit() {
+	std::lock_guard<std::shared_mutex> lock(poolMutex);
+	commitLocked();
+}
+
+void Pager::commitLocked() {
+	if (!wal)
+		return;
+
+	std::vector<std::pair<uint32_t, char *>> dirtyPages;
+	for (Frame &f : frames) {
+		if (f.dirty) {
+			dirtyPages.push_back({f.pageNum, f.data});
+		}
+	}
+
+	if (dirtyPages.empty()) {
+		if (!logHasUncommitted)
+			return;
+		//everything was already logged by eviction, only the commit frame is missing
+		dirtyPages.push_back({0, frames[getFrame(0)].data});
+	}
+
+	wal->appendFrames(dirtyPages, numOfPages);
+	for (Frame &f : frames) {
+		f.dirty = false;
+	}
+	logHasUncommitted = false;
+
+	//the flusher checkpoints in the background, only fall back
+	//to checkpointing here when it can't keep up
+	uint32_t threshold = walOptions.checkpointFrames;
+	if (flusher.joinable()) {
+		threshold *= 2;
+	}
+	if (wal->getNumOfFrames() >= threshold) {
+		checkpointWal();
 	}
 }
 
 int Pager::_close() {
+	stopFlushing();
+	stopPrefetching();
+	if (wal) {
+		wal->_close(true);
+		delete wal;
+		wal = nullptr;
+	}
+	if (compressed) {
+		compressed->sync();
+	}
 	return close(fileDescriptor);
-}
\ No newline at end of file
+}
@@ -3,42 +3,249 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "wal.hpp"
+#include "compressed_file.hpp"
 
 static constexpr uint32_t PAGE_SIZE = 4096;
-static constexpr uint32_t MAX_PAGES = 100;
+
+//default frame budget of the buffer pool (1 MB)
+static constexpr uint32_t DEFAULT_POOL_FRAMES = 256;
+//a split holds up to three pages plus the cursor's leaf
+static constexpr uint32_t MIN_POOL_FRAMES = 8;
+//the frames of the pool are carved from one slab aligned to this, so
+//the kernel can back it with huge pages
+static constexpr size_t POOL_SLAB_ALIGNMENT = 2 * 1024 * 1024;
+//the background flusher wakes up this often...
+static constexpr uint32_t DEFAULT_FLUSH_INTERVAL_MS = 100;
+//...and writes at most this many dirty pages per wake up
+static constexpr uint32_t DEFAULT_FLUSH_BATCH_PAGES = 64;
+//pages requested ahead of a sequential scan
+static constexpr uint32_t DEFAULT_READ_AHEAD_PAGES = 64;
+//misses this many pages apart still count as sequential, the
+//leaves of a bulk load are interleaved with internal nodes
+static constexpr uint32_t SEQUENTIAL_MISS_GAP = 4;
+//ascending misses in a row before read-ahead starts
+static constexpr uint32_t SEQUENTIAL_MISS_RUN = 2;
+
+enum class PagerMode {
+	//pages are read into frames of the buffer pool
+	Buffered,
+	//pages are handed out straight from a shared mapping of the file
+	Mmap
+};
+
+enum class Latch {
+	//readers, any number at a time
+	Shared,
+	//one writer, nobody else
+	Exclusive
+};
+
+struct PagerOptions {
+	PagerMode mode = PagerMode::Buffered;
+	uint32_t maxFrames = DEFAULT_POOL_FRAMES;
+	//0 disables the background flusher
+	uint32_t flushIntervalMs = DEFAULT_FLUSH_INTERVAL_MS;
+	uint32_t flushBatchPages = DEFAULT_FLUSH_BATCH_PAGES;
+	//0 disables read-ahead
+	uint32_t readAheadPages = DEFAULT_READ_AHEAD_PAGES;
+	//a new file stores compressed page images, existing files keep their format
+	bool compress = false;
+	//read and write the database file with O_DIRECT, the pool is its only cache
+	bool direct = false;
+	WalOptions wal;
+};
+
+/*********
+ FRAME
+ A slot of the buffer pool holding one page. Hits pin and
+ reference a frame under the shared pool lock, so those two
+ are atomic, the rest changes under the exclusive lock.
+*********/
+struct Frame {
+	char *data;
+	uint32_t pageNum;
+	std::atomic<uint32_t> pinCount;
+	bool dirty;
+	//CLOCK reference bit, set on every access
+	std::atomic<bool> referenced;
+	//guards the content of the page, see latchPage()
+	std::shared_mutex latch;
+
+	explicit Frame(char *data)
+	    : data(data), pageNum(0), pinCount(0), dirty(false), referenced(false) {
+	}
+};
 
 /*********
  PAGER CLASS
  Pager class contains the memory we read/write to.
  We request the pager to give us a page(size: 4096 bytes)
- and it returns that page. It will first look in the cache,
- if it doesn't find the page there, it will get that page
- from the disk
+ and it returns that page. It will first look in the buffer
+ pool, if it doesn't find the page there, it will get that page
+ from the disk into a free frame, evicting an unpinned frame
+ (CLOCK) when the pool is at its frame budget. Dirty frames
+ are written back before they are reused.
+
+ With the write-ahead log enabled the database file is never
+ written in place outside of a checkpoint: commit() appends the
+ dirty pages to the log and evicted dirty pages go to the log as
+ uncommitted frames. Misses look in the log before the file.
+
+ A compressed file is read and written through CompressedFile,
+ the frames always hold uncompressed pages. Compressed files
+ don't support the log.
+
+ With direct I/O the database file bypasses the page cache: the
+ frames are page aligned, so pages go between them and the disk
+ with pread and pwrite, and the pool is the only copy in memory.
+ Read-ahead through the page cache would be wasted and is off.
+ Writes reach the device as they are issued, durability still
+ comes from the log and from flushAll().
+
+ A background flusher writes dirty, unpinned frames in page
+ order, a batch per interval, coalescing adjacent pages into one
+ pwritev. With the log it runs the checkpoints instead. Pages
+ are marked dirty after they are modified, so a page changed
+ while the flusher writes it is simply written again later.
+
+ Misses in ascending page order, like a scan along the leaf
+ chain, start read-ahead: a prefetcher thread asks the kernel
+ for the next pages with posix_fadvise, so the reads of the scan
+ find them in the page cache instead of waiting on the disk.
+ Leaves split by random inserts link to pages far apart, there
+ misses never look sequential; cursors name the leaf after the
+ one they move to with prefetchPage() instead, which reads a
+ single leaf ahead only.
+
+ A pointer returned by getPage() stays valid until the next
+ page miss. Callers holding a page across other page accesses
+ must pin it with pinPage() and release it with unpinPage().
+
+ The pool can be shared by threads. Lookups that hit take the
+ pool lock shared, only misses and write backs take it alone.
+ Every frame has a reader/writer latch: latchPage() pins the
+ page and takes the latch, readers shared and the writer
+ exclusive, and unlatchPage() gives both back. The pool lock is
+ never held while waiting for a latch.
+
+ Both still find the frame in the page table under the shared
+ pool lock, a page pinned already included: a miss may rehash the
+ table under them. Every latch and unlatch so updates the one
+ reader count of poolMutex, which caps how well readers on many
+ cores scale even when they touch different pages (the Mmap pager
+ has the same limit with its latch table). Latches also prefer
+ readers, a writer waits until no reader holds the page.
 *********/
 class Pager{
+protected:
 	int fileDescriptor;
-	uint32_t fileLength;
-	char *pages[MAX_PAGES];
+	uint64_t fileLength;
 	uint32_t numOfPages;
+	WalOptions walOptions;
+	Wal *wal;
+	//frames were logged by eviction since the last commit
+	bool logHasUncommitted;
+	//set when the file holds compressed page images
+	CompressedFile *compressed;
+	bool compressNewFile;
+	//the database file was opened for direct I/O
+	bool direct;
+
+	void replayWal(const std::string &filename);
+	void checkpointWal();
+
+private:
+	uint32_t maxFrames;
+	uint32_t clockHand;
+	//a deque, frames never move once created
+	std::deque<Frame> frames;
+	//maxFrames pages back to back, frame i holds page data i,
+	//mapped by the first miss and touched one frame at a time
+	char *slab;
+	size_t slabLength;
+	//pageNum -> index into frames
+	std::unordered_map<uint32_t, uint32_t> pageTable;
+
+	//guards the frames, the page table and the log, shared for hits
+	std::shared_mutex poolMutex;
+	std::condition_variable_any flushCond;
+	std::thread flusher;
+	bool stopFlusher;
+	uint32_t flushIntervalMs;
+	uint32_t flushBatchPages;
+	//page number the next flusher batch starts from
+	uint32_t flushCursor;
+
+	uint32_t readAheadPages;
+	uint32_t lastMissPage;
+	uint32_t sequentialMisses;
+	//pages below this were already handed to the prefetcher
+	uint32_t readAheadEnd;
+	//page ranges (first, count) waiting for the prefetcher
+	std::deque<std::pair<uint32_t, uint32_t>> prefetchQueue;
+	std::mutex prefetchMutex;
+	std::condition_variable prefetchCond;
+	std::thread prefetcher;
+	bool stopPrefetcher;
+
+	void mapSlab();
+	uint32_t findVictim();
+	uint32_t getFrame(uint32_t pageNum);
+	Frame &pinFrame(uint32_t pageNum);
+	void writeFrame(Frame &frame);
+	void writeRuns(const std::vector<uint32_t> &batch);
+	void flushLoop();
+	void stopFlushing();
+	void noteMiss(uint32_t pageNum);
+	void prefetchLoop();
+	void stopPrefetching();
+	void commitLocked();
 
 public:
-	Pager() noexcept;
-	~Pager();
+	explicit Pager(const PagerOptions &options = PagerOptions()) noexcept;
+	virtual ~Pager();
 
 	inline uint32_t getNumOfPages() {
 		return numOfPages;
 	}
 
-	void _open(std::string filename);
-	char *getPage(uint32_t pageNum);
+	virtual void _open(std::string filename);
+	virtual char *getPage(uint32_t pageNum);
+	virtual char *pinPage(uint32_t pageNum);
+	virtual void unpinPage(uint32_t pageNum);
+	virtual char *latchPage(uint32_t pageNum, Latch mode);
+	virtual void unlatchPage(uint32_t pageNum, Latch mode);
+	virtual void markDirty(uint32_t pageNum);
+	void prefetchPage(uint32_t pageNum);
 	uint32_t getUnusedPageNum();
-	void _flush(uint32_t pageNum);
-	int _close();
+	void freePage(uint32_t pageNum);
+	virtual void _flush(uint32_t pageNum);
+	virtual void flushAll();
+	virtual void commit();
+	virtual int _close();
 
 	//return the file length
-	inline uint32_t getFileLength() {
+	inline uint64_t getFileLength() {
 		return fileLength;
 	}
+
+	inline uint32_t getMaxFrames() {
+		return maxFrames;
+	}
+
+	inline bool isCompressed() {
+		return compressed != nullptr;
+	}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,58 @@
+#include <cerrno>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+
+static bool send_all(int fd, const char *data, size_t n) {
+	while (n > 0) {
+		ssize_t sent = send(fd, data, n, MSG_NOSIGNAL);
+		if (sent > 0) {
+			data += sent;
+			n -= sent;
+			continue;
+		}
+		if (sent == -1 && errno == EINTR)
+			continue;
+		if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//non-blocking socket of the server, wait for the client to read
+			pollfd p = {fd, POLLOUT, 0};
+			if (poll(&p, 1, -1) == -1 && errno != EINTR)
+				return false;
+			if (p.revents & (POLLERR | POLLHUP))
+				return false;
+			continue;
+		}
+		return false;
+	}
+	return true;
+}
+
+static bool recv_all(int fd, char *data, size_t n) {
+	while (n > 0) {
+		ssize_t received = recv(fd, data, n, 0);
+		if (received > 0) {
+			data += received;
+			n -= received;
+			continue;
+		}
+		if (received == -1 && errno == EINTR)
+			continue;
+		return false;
+	}
+	return true;
+}
+
+bool send_frame(int fd, const char *data, uint32_t n) {
+	return send_all(fd, reinterpret_cast<const char *>(&n), sizeof(n)) && send_all(fd, data, n);
+}
+
+bool recv_frame(int fd, std::string &data) {
+	uint32_t n;
+	if (!recv_all(fd, reinterpret_cast<char *>(&n), sizeof(n)))
+		return false;
+	data.resize(n);
+	return recv_all(fd, data.data(), n);
+}
@@ -0,0 +1,34 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+//longest request the server reads, a longer one closes the connection
+static constexpr uint32_t MAX_REQUEST_SIZE = 1 << 20;
+
+/*
+ * Protocol
+ * Client and server exchange frames over a Unix domain socket: a
+ * 4 byte length in host byte order followed by that many bytes.
+ * A request is one frame holding a statement or a meta command,
+ * as typed at the shell prompt. The server answers with frames
+ * holding exactly what the shell would have printed for it, rows
+ * first, and ends the answer with an empty frame. Requests on one
+ * connection are answered in order.
+ */
+
+/**
+ * @brief write one frame, waiting while the socket is full
+ * @returns false if the peer is gone
+ */
+bool send_frame(int fd, const char *data, uint32_t n);
+
+/**
+ * @brief read one whole frame into data, blocking until it arrived
+ * @returns false on end of file or an error
+ */
+bool recv_frame(int fd, std::string &data);
+
+#endif
@@ -0,0 +1,155 @@
+#include <cstring>
+
+#include "result_sink.hpp"
+#include "row.hpp"
+
+//"00" "01" ... "99", two digits per lookup
+static const char DIGIT_PAIRS[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+ResultSink::ResultSink(std::ostream &out, OutputMode mode)
+    : used(0), mode(mode), out(&out) {
+    buffer = new char[RESULT_BUFFER_SIZE];
+}
+
+ResultSink::ResultSink(OutputMode mode)
+    : used(0), mode(mode), out(nullptr) {
+    buffer = new char[RESULT_BUFFER_SIZE];
+}
+
+ResultSink::~ResultSink() {
+    flush();
+    delete[] buffer;
+}
+
+bool parse_output_mode(std::string_view name, OutputMode &mode) {
+	if (name == "table") {
+		mode = OutputMode::Table;
+	} else if (name == "csv") {
+		mode = OutputMode::Csv;
+	} else if (name == "tsv") {
+		mode = OutputMode::Tsv;
+	} else if (name == "binary") {
+		mode = OutputMode::Binary;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void ResultSink::write(const char *data, size_t n) {
+	out->write(data, n);
+	out->flush();
+}
+
+void ResultSink::flush() {
+	if (used == 0)
+		return;
+	write(buffer, used);
+	used = 0;
+}
+
+void ResultSink::append(const char *data, size_t n) {
+	reserve(n);
+	memcpy(buffer + used, data, n);
+	used += n;
+}
+
+void ResultSink::appendNumber(uint32_t value) {
+	char digits[10];
+	char *p = digits + sizeof(digits);
+	while (value >= 100) {
+		uint32_t pair = (value % 100) * 2;
+		value /= 100;
+		*--p = DIGIT_PAIRS[pair + 1];
+		*--p = DIGIT_PAIRS[pair];
+	}
+	if (value >= 10) {
+		*--p = DIGIT_PAIRS[value * 2 + 1];
+		*--p = DIGIT_PAIRS[value * 2];
+	} else {
+		*--p = '0' + value;
+	}
+	append(p, digits + sizeof(digits) - p);
+}
+
+/**
+ * @brief append a CSV field, quoted when it contains a separator,
+ * a quote or a line break (RFC 4180)
+ */
+void ResultSink::appendCsvField(const char *field, size_t n) {
+	bool quote = false;
+	for (size_t i = 0; i < n && !quote; ++i) {
+		quote = field[i] == ',' || field[i] == '"' || field[i] == '\r' || field[i] == '\n';
+	}
+	if (!quote) {
+		append(field, n);
+		return;
+	}
+
+	append("\"", 1);
+	for (size_t i = 0; i < n; ++i) {
+		if (field[i] == '"') {
+			append("\"\"", 2);
+		} else {
+			append(field + i, 1);
+		}
+	}
+	append("\"", 1);
+}
+
+/**
+ * @brief format one row from its record
+ */
+void ResultSink::writeRow(const char *record) {
+	RecordView row = view_record(record);
+	if (mode == OutputMode::Binary) {
+		append(record, row.size);
+		return;
+	}
+
+	uint32_t id = row.id;
+	const char *username = row.username.data();
+	const char *email = row.email.data();
+	size_t usernameLength = row.username.size();
+	size_t emailLength = row.email.size();
+
+	switch (mode) {
+		case OutputMode::Table:
+			append("(", 1);
+			appendNumber(id);
+			append(", ", 2);
+			append(username, usernameLength);
+			append(", ", 2);
+			append(email, emailLength);
+			append(")\n", 2);
+			break;
+		case OutputMode::Csv:
+			appendNumber(id);
+			append(",", 1);
+			appendCsvField(username, usernameLength);
+			append(",", 1);
+			appendCsvField(email, emailLength);
+			append("\n", 1);
+			break;
+		case OutputMode::Tsv:
+			appendNumber(id);
+			append("\t", 1);
+			append(username, usernameLength);
+			append("\t", 1);
+			append(email, emailLength);
+			append("\n", 1);
+			break;
+		case OutputMode::Binary:
+			break;
+	}
+}
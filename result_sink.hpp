@@ -0,0 +1,70 @@
+#ifndef RESULT_SINK_H
+#define RESULT_SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+#include <string_view>
+
+//bytes collected before they are handed to the stream
+static constexpr size_t RESULT_BUFFER_SIZE = 64 * 1024;
+
+enum class OutputMode {
+	//(id, username, email), the format of Row::print
+	Table,
+	Csv,
+	Tsv,
+	//the record of the row as stored in the leaf, see view_record()
+	Binary
+};
+
+//the mode named by .mode, false for an unknown name
+bool parse_output_mode(std::string_view name, OutputMode &mode);
+
+/***************
+ RESULT SINK CLASS
+ Formats result rows straight from their records
+ (a leaf cell value) into one reusable buffer,
+ and hands the buffer to the output stream in large
+ writes instead of one stream operation per field.
+***************/
+class ResultSink {
+	char *buffer;
+	size_t used;
+	OutputMode mode;
+	std::ostream *out;
+
+	inline void reserve(size_t n) {
+		if (used + n > RESULT_BUFFER_SIZE) {
+			flush();
+		}
+	}
+
+	void append(const char *data, size_t n);
+	void appendNumber(uint32_t value);
+	void appendCsvField(const char *field, size_t n);
+
+protected:
+	//for sinks that override write() instead of using a stream
+	explicit ResultSink(OutputMode mode);
+
+	//hand the buffered bytes to the output
+	virtual void write(const char *data, size_t n);
+
+public:
+	explicit ResultSink(std::ostream &out, OutputMode mode = OutputMode::Table);
+	virtual ~ResultSink();
+
+	inline void setMode(OutputMode mode) {
+		this->mode = mode;
+	}
+
+	inline OutputMode getMode() {
+		return mode;
+	}
+
+	void writeRow(const char *record);
+	void flush();
+};
+
+#endif
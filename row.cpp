@@ -6,13 +6,26 @@ void Row::print() {
 }
 
 void Row::serialize(char *dest) {
-	memcpy(dest + ID_OFFSET, &(id), ID_SIZE);
-	memcpy(dest + USERNAME_OFFSET, &(username), USERNAME_SIZE);
-	memcpy(dest + EMAIL_OFFSET, &(email), EMAIL_SIZE);
+	memcpy(dest, this, ROW_SIZE);
 }
 
 void Row::deserialize(char *src) {
-	memcpy(&(id), src + ID_OFFSET, ID_SIZE);
-	memcpy(&(username), src + USERNAME_OFFSET, USERNAME_SIZE);
-	memcpy(&(email), src + EMAIL_OFFSET, EMAIL_SIZE);
+	memcpy(this, src, ROW_SIZE);
+}
+
+uint32_t Row::encode(char *dest) {
+	return UserSchema::encode(reinterpret_cast<const char *>(this), dest);
+}
+
+void Row::decode(const char *record) {
+	UserSchema::decode(record, reinterpret_cast<char *>(this));
+}
+
+RecordView view_record(const char *record) {
+	RecordView view;
+	view.id = UserSchema::key(record);
+	view.username = UserSchema::text<USERNAME_COLUMN>(record);
+	view.email = UserSchema::text<EMAIL_COLUMN>(record);
+	view.size = UserSchema::recordSize(record);
+	return view;
 }
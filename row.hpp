@@ -3,20 +3,51 @@
 
 #include <stdint.h>
 #include <cstring>
+#include <string_view>
+#include <cstddef>
+
+#include "schema.hpp"
+
+//the users table: id, username and email
+using UserSchema = Schema<KeyColumn, TextColumn<32>, TextColumn<64>>;
+
+//where the columns are in UserSchema
+static constexpr size_t ID_COLUMN = 0;
+static constexpr size_t USERNAME_COLUMN = 1;
+static constexpr size_t EMAIL_COLUMN = 2;
+
+/*
+ * Record Layout
+ * Leaves store rows as records: the id (4 bytes), then the
+ * username and the email, each as a varint length followed
+ * by its bytes, without padding or terminator. The lengths
+ * always fit one byte, see TextColumn.
+ */
+struct RecordView {
+	uint32_t id;
+	//point into the record
+	std::string_view username;
+	std::string_view email;
+	//bytes of the whole record
+	uint32_t size;
+};
+
+RecordView view_record(const char *record);
 
 struct Row {
 
 	uint32_t id;
-	char username[32];
-	char email[64];
+	char username[UserSchema::Column<USERNAME_COLUMN>::SIZE];
+	char email[UserSchema::Column<EMAIL_COLUMN>::SIZE];
 
 	static constexpr size_t ID_SIZE = sizeof(id);
 	static constexpr size_t USERNAME_SIZE = sizeof(username);
 	static constexpr size_t EMAIL_SIZE = sizeof(email);
-	static constexpr uint32_t ID_OFFSET = 0;
-	static constexpr uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
-	static constexpr uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE;
-	static constexpr uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
+	static constexpr uint32_t ID_OFFSET = UserSchema::offset<ID_COLUMN>();
+	static constexpr uint32_t USERNAME_OFFSET = UserSchema::offset<USERNAME_COLUMN>();
+	static constexpr uint32_t EMAIL_OFFSET = UserSchema::offset<EMAIL_COLUMN>();
+	static constexpr uint32_t ROW_SIZE = UserSchema::ROW_SIZE;
+	static constexpr uint32_t RECORD_MAX_SIZE = UserSchema::RECORD_MAX_SIZE;
 
     void print();
 
@@ -24,9 +55,18 @@ struct Row {
 
 	void deserialize(char *src);
 
+	//write the record of this row to dest, returns its size
+	uint32_t encode(char *dest);
+
+	void decode(const char *record);
+
 	inline static constexpr uint32_t rowSize() {
 		return ROW_SIZE;
 	}
 };
 
+//serialize(), encode() and decode() hand the struct to UserSchema as its row
+static_assert(sizeof(Row) == UserSchema::ROW_SIZE && offsetof(Row, username) == Row::USERNAME_OFFSET &&
+              offsetof(Row, email) == Row::EMAIL_OFFSET, "Row is laid out like a UserSchema row");
+
 #endif
\ No newline at end of file
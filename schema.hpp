@@ -0,0 +1,164 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Column types of a Schema. Each knows its width in the fixed row,
+ * the most bytes it takes in a record, and how to write, read and
+ * step over itself in a record.
+ */
+
+//the id every table is keyed on, 4 bytes in the row and the record
+struct KeyColumn {
+	static constexpr uint32_t SIZE = sizeof(uint32_t);
+	static constexpr uint32_t RECORD_MAX_SIZE = SIZE;
+
+	static inline char *encode(const char *field, char *dest) {
+		memcpy(dest, field, SIZE);
+		return dest + SIZE;
+	}
+
+	static inline const char *decode(const char *src, char *field) {
+		memcpy(field, src, SIZE);
+		return src + SIZE;
+	}
+
+	static inline const char *skip(const char *src) {
+		return src + SIZE;
+	}
+};
+
+//NUL terminated text of up to CAPACITY - 1 bytes in the row, a length
+//byte and the bytes without padding in the record. Bytes of the row
+//past CAPACITY - 1 are never encoded, a field always decodes with its NUL.
+template <uint32_t CAPACITY>
+struct TextColumn {
+	//the length byte is a one byte varint
+	static_assert(CAPACITY < 128, "text columns are shorter than 128 bytes");
+
+	static constexpr uint32_t SIZE = CAPACITY;
+	//the length byte and at most CAPACITY - 1 bytes
+	static constexpr uint32_t RECORD_MAX_SIZE = CAPACITY;
+
+	static inline char *encode(const char *field, char *dest) {
+		uint32_t length = strnlen(field, CAPACITY - 1);
+		*dest = (char)length;
+		memcpy(dest + 1, field, length);
+		return dest + 1 + length;
+	}
+
+	static inline const char *decode(const char *src, char *field) {
+		uint32_t length = (uint8_t)*src;
+		memcpy(field, src + 1, length);
+		memset(field + length, 0, CAPACITY - length);
+		return src + 1 + length;
+	}
+
+	static inline const char *skip(const char *src) {
+		return src + 1 + (uint8_t)*src;
+	}
+
+	static inline std::string_view view(const char *src) {
+		return std::string_view(src + 1, (uint8_t)*src);
+	}
+};
+
+/*********
+ SCHEMA
+ Layout of the rows of a table, the first column being its key.
+ A row is the columns back to back at fixed offsets, what a struct
+ of the same members looks like in memory; a record, what the
+ leaves store, is the columns without their padding. Every
+ offset and bound is a constant and encoding, decoding and column
+ access unroll into straight code for the columns of the table,
+ nothing looks at the schema at run time.
+
+ The leaves are slotted pages and hold records of any schema, the
+ schema only bounds their size, see RECORD_MAX_SIZE.
+
+ The record format, the layout of Row with its serialize() and
+ the sizes of the indexed columns (INDEX_COLUMN_SIZE) come from
+ UserSchema. The rest of the engine still works on the one table
+ of Row: Table, RowSource, the statements, the column names of
+ RecordView and IndexColumn all name it, so a table of another
+ schema would need those to take the schema as a parameter first.
+*********/
+template <typename... Columns>
+struct Schema {
+	template <size_t I>
+	using Column = std::tuple_element_t<I, std::tuple<Columns...>>;
+
+	static_assert(std::is_same<Column<0>, KeyColumn>::value, "the first column is the key");
+
+	static constexpr size_t NUM_COLUMNS = sizeof...(Columns);
+	static constexpr uint32_t ROW_SIZE = (Columns::SIZE + ...);
+	static constexpr uint32_t RECORD_MAX_SIZE = (Columns::RECORD_MAX_SIZE + ...);
+
+	//where column I starts in the row
+	template <size_t I>
+	static constexpr uint32_t offset() {
+		constexpr uint32_t sizes[] = {Columns::SIZE...};
+		uint32_t result = 0;
+		for (size_t i = 0; i < I; ++i) {
+			result += sizes[i];
+		}
+		return result;
+	}
+
+	//write the record of row to dest, returns its size
+	static inline uint32_t encode(const char *row, char *dest) {
+		return encodeColumns(row, dest, std::index_sequence_for<Columns...>());
+	}
+
+	//fill row from record, text columns padded with NULs
+	static inline void decode(const char *record, char *row) {
+		decodeColumns(record, row, std::index_sequence_for<Columns...>());
+	}
+
+	static inline uint32_t key(const char *record) {
+		uint32_t id;
+		memcpy(&id, record, KeyColumn::SIZE);
+		return id;
+	}
+
+	//the bytes of text column I in record
+	template <size_t I>
+	static inline std::string_view text(const char *record) {
+		return Column<I>::view(skipColumns(record, std::make_index_sequence<I>()));
+	}
+
+	//bytes of the whole record
+	static inline uint32_t recordSize(const char *record) {
+		return skipColumns(record, std::index_sequence_for<Columns...>()) - record;
+	}
+
+private:
+	template <size_t... Is>
+	static inline uint32_t encodeColumns(const char *row, char *dest, std::index_sequence<Is...>) {
+		char *p = dest;
+		((p = Column<Is>::encode(row + offset<Is>(), p)), ...);
+		return p - dest;
+	}
+
+	template <size_t... Is>
+	static inline void decodeColumns(const char *record, char *row, std::index_sequence<Is...>) {
+		const char *p = record;
+		((p = Column<Is>::decode(p, row + offset<Is>())), ...);
+	}
+
+	template <size_t... Is>
+	static inline const char *skipColumns(const char *record, std::index_sequence<Is...>) {
+		const char *p = record;
+		((p = Column<Is>::skip(p)), ...);
+		return p;
+	}
+};
+
+#endif
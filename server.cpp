@@ -0,0 +1,310 @@
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.hpp"
+#include "protocol.hpp"
+#include "table.hpp"
+
+//bytes taken from a socket per read
+static constexpr size_t SERVER_READ_SIZE = 16 * 1024;
+//events handled per epoll_wait
+static constexpr int SERVER_MAX_EVENTS = 64;
+
+ConnectionSink::ConnectionSink(int fileDescriptor)
+    : ResultSink(OutputMode::Table), fileDescriptor(fileDescriptor), failed(false) {}
+
+ConnectionSink::~ConnectionSink() {
+    //the base destructor can't reach write() of this class any more
+    flush();
+}
+
+void ConnectionSink::write(const char *data, size_t n) {
+	if (!failed && !send_frame(fileDescriptor, data, n)) {
+		failed = true;
+	}
+}
+
+Server::Server(Table *table, const std::string &socketPath, uint32_t numOfWorkers) {
+    this->table = table;
+    this->socketPath = socketPath;
+    this->numOfWorkers = numOfWorkers > 0 ? numOfWorkers : 1;
+    epollDescriptor = -1;
+    stopping = false;
+
+    //blocked in every thread started from here on, they only
+    //arrive through signalDescriptor
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signalDescriptor = signalfd(-1, &signals, SFD_CLOEXEC);
+    if (signalDescriptor == -1) {
+        std::cout << "Unable to watch for signals\n";
+        exit(EXIT_FAILURE);
+    }
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cout << "Socket path too long\n";
+        exit(EXIT_FAILURE);
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+
+    //a socket left behind by a server that didn't shut down
+    struct stat st;
+    if (lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socketPath.c_str());
+    }
+
+    listenDescriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenDescriptor == -1 ||
+        bind(listenDescriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1 ||
+        listen(listenDescriptor, SERVER_BACKLOG) == -1) {
+        std::cout << "Unable to listen on " << socketPath << ": " << strerror(errno) << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+Server::~Server() {
+    close(listenDescriptor);
+    unlink(socketPath.c_str());
+    if (epollDescriptor != -1) {
+        close(epollDescriptor);
+    }
+    close(signalDescriptor);
+}
+
+/**
+ * @brief run the event loop until SIGINT or SIGTERM, then close
+ * every connection once the workers finished their requests
+ */
+void Server::run() {
+	epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+	if (epollDescriptor == -1) {
+		std::cout << "Unable to start the event loop\n";
+		exit(EXIT_FAILURE);
+	}
+	for (int fd : {listenDescriptor, signalDescriptor}) {
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, fd, &event);
+	}
+
+	for (uint32_t i = 0; i < numOfWorkers; ++i) {
+		workers.emplace_back(&Server::workerLoop, this);
+	}
+	std::cout << "Listening on " << socketPath << std::endl;
+
+	epoll_event events[SERVER_MAX_EVENTS];
+	bool running = true;
+	while (running) {
+		int numOfEvents = epoll_wait(epollDescriptor, events, SERVER_MAX_EVENTS, -1);
+		if (numOfEvents == -1) {
+			if (errno == EINTR)
+				continue;
+			std::cout << "Error waiting for events. Exiting...\n";
+			exit(EXIT_FAILURE);
+		}
+
+		for (int i = 0; i < numOfEvents; ++i) {
+			int fd = events[i].data.fd;
+			if (fd == listenDescriptor) {
+				acceptConnections();
+			} else if (fd == signalDescriptor) {
+				signalfd_siginfo info;
+				if (read(signalDescriptor, &info, sizeof(info)) == sizeof(info)) {
+					running = false;
+				}
+			} else {
+				Connection *conn;
+				{
+					std::lock_guard<std::mutex> lock(connectionsMutex);
+					auto it = connections.find(fd);
+					if (it == connections.end())
+						continue;
+					conn = it->second;
+				}
+				{
+					std::lock_guard<std::mutex> lock(readyMutex);
+					ready.push_back(conn);
+				}
+				readyCond.notify_one();
+			}
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(readyMutex);
+		stopping = true;
+	}
+	readyCond.notify_all();
+	{
+		//a worker waiting on a client that doesn't read gives up
+		std::lock_guard<std::mutex> lock(connectionsMutex);
+		for (auto &entry : connections) {
+			shutdown(entry.first, SHUT_RDWR);
+		}
+	}
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+
+	for (auto &entry : connections) {
+		table->commit(&entry.second->st);
+		close(entry.first);
+		delete entry.second;
+	}
+	connections.clear();
+	ready.clear();
+}
+
+void Server::acceptConnections() {
+	while (true) {
+		int fd = accept4(listenDescriptor, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1) {
+			if (errno == EINTR)
+				continue;
+			//EAGAIN once the backlog is empty, anything else drops the client
+			return;
+		}
+
+		Connection *conn = new Connection(fd);
+		{
+			std::lock_guard<std::mutex> lock(connectionsMutex);
+			connections[fd] = conn;
+		}
+		epoll_event event = {};
+		event.events = EPOLLIN | EPOLLONESHOT;
+		event.data.fd = fd;
+		if (epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, fd, &event) == -1) {
+			closeConnection(conn);
+		}
+	}
+}
+
+void Server::workerLoop() {
+	while (true) {
+		Connection *conn;
+		{
+			std::unique_lock<std::mutex> lock(readyMutex);
+			readyCond.wait(lock, [this] { return stopping || !ready.empty(); });
+			if (stopping)
+				return;
+			conn = ready.front();
+			ready.pop_front();
+		}
+
+		if (!serve(conn)) {
+			closeConnection(conn);
+			continue;
+		}
+		epoll_event event = {};
+		event.events = EPOLLIN | EPOLLONESHOT;
+		event.data.fd = conn->fileDescriptor;
+		if (epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, conn->fileDescriptor, &event) == -1) {
+			closeConnection(conn);
+		}
+	}
+}
+
+/**
+ * @brief read what the client sent and answer every whole request in it
+ * @returns false once the connection should be closed: the client
+ * hung up or sent .exit, or its socket failed
+ */
+bool Server::serve(Connection *conn) {
+	char buffer[SERVER_READ_SIZE];
+	while (true) {
+		ssize_t n = recv(conn->fileDescriptor, buffer, sizeof(buffer), 0);
+		if (n > 0) {
+			conn->input.append(buffer, n);
+			continue;
+		}
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		return false;
+	}
+
+	size_t pos = 0;
+	while (conn->input.size() - pos >= sizeof(uint32_t)) {
+		uint32_t length;
+		memcpy(&length, conn->input.data() + pos, sizeof(length));
+		if (length > MAX_REQUEST_SIZE)
+			return false;
+		if (conn->input.size() - pos - sizeof(length) < length)
+			break;
+
+		std::string_view request(conn->input.data() + pos + sizeof(length), length);
+		if (!answer(conn, request))
+			return false;
+		pos += sizeof(length) + length;
+	}
+	conn->input.erase(0, pos);
+	return true;
+}
+
+/**
+ * @brief run one request and send its answer, rows first, then
+ * the outcome, then the empty frame that ends the answer
+ */
+bool Server::answer(Connection *conn, std::string_view request) {
+	std::ostringstream out;
+	if (!request.empty() && request[0] == '.') {
+		if (request == ".exit")
+			return false;
+
+		if (request.compare(0, 6, ".mode ") == 0) {
+			std::string_view name = request.substr(6);
+			OutputMode mode;
+			if (parse_output_mode(name, mode)) {
+				conn->sink.setMode(mode);
+			} else {
+				out << "Unknown mode " << name << ", use table, csv, tsv or binary\n";
+			}
+		} else {
+			//the other meta commands print the database, they stay with the shell
+			out << "Unrecognized command!\n";
+		}
+	} else {
+		conn->st.run(request, table, conn->sink, out);
+	}
+
+	conn->sink.flush();
+	if (conn->sink.hasFailed())
+		return false;
+	std::string message = out.str();
+	if (!message.empty() && !send_frame(conn->fileDescriptor, message.data(), message.size()))
+		return false;
+	return send_frame(conn->fileDescriptor, nullptr, 0);
+}
+
+/**
+ * @brief a transaction the client left open is committed, there is
+ * no rollback and the others can't write until it ends
+ */
+void Server::closeConnection(Connection *conn) {
+	table->commit(&conn->st);
+	{
+		std::lock_guard<std::mutex> lock(connectionsMutex);
+		connections.erase(conn->fileDescriptor);
+	}
+	close(conn->fileDescriptor);
+	delete conn;
+}
@@ -0,0 +1,110 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "statement.hpp"
+#include "result_sink.hpp"
+
+class Table;
+
+//threads executing requests
+static constexpr uint32_t DEFAULT_SERVER_WORKERS = 4;
+//connections waiting to be accepted
+static constexpr int SERVER_BACKLOG = 64;
+
+/*
+ * Rows of a select go out as frames of the answer
+ * while the select runs, not collected first.
+ */
+class ConnectionSink : public ResultSink {
+	int fileDescriptor;
+	bool failed;
+
+protected:
+	void write(const char *data, size_t n) override;
+
+public:
+	explicit ConnectionSink(int fileDescriptor);
+	~ConnectionSink() override;
+
+	//a write found the client gone
+	inline bool hasFailed() {
+		return failed;
+	}
+};
+
+/*********
+ SERVER CLASS
+ Serves one open table to any number of local clients
+ over a Unix domain socket, see protocol.hpp. They all
+ share the table and its buffer pool, so a page one
+ client brought in is a hit for the others.
+
+ An epoll loop on the main thread accepts connections
+ and hands the ones with a request to a pool of worker
+ threads. A connection is armed one shot, so one worker
+ at a time owns it and its requests run in order; it is
+ armed again once the worker has answered everything it
+ read. Selects of different clients run side by side,
+ statements that write take turns on the table.
+
+ A transaction belongs to the connection that began it,
+ the writes of the other clients are refused until it
+ commits. A client that hangs up commits what it left open.
+*********/
+class Server {
+	struct Connection {
+		int fileDescriptor;
+		//bytes read that don't make a whole request yet
+		std::string input;
+		//each client has its own statement and output mode
+		Statement st;
+		ConnectionSink sink;
+
+		explicit Connection(int fileDescriptor)
+		    : fileDescriptor(fileDescriptor), sink(fileDescriptor) {}
+	};
+
+	Table *table;
+	std::string socketPath;
+	uint32_t numOfWorkers;
+	int listenDescriptor;
+	int epollDescriptor;
+	int signalDescriptor;
+
+	//connections by descriptor, for the event loop and shutdown
+	std::unordered_map<int, Connection *> connections;
+	std::mutex connectionsMutex;
+
+	//connections with something to read, each in here at most once
+	std::deque<Connection *> ready;
+	std::mutex readyMutex;
+	std::condition_variable readyCond;
+	bool stopping;
+	std::vector<std::thread> workers;
+
+	void acceptConnections();
+	void workerLoop();
+	bool serve(Connection *conn);
+	bool answer(Connection *conn, std::string_view request);
+	void closeConnection(Connection *conn);
+
+public:
+	//blocks SIGINT and SIGTERM, create it before the table is
+	//opened so the threads of the pager don't take them
+	Server(Table *table, const std::string &socketPath, uint32_t numOfWorkers = DEFAULT_SERVER_WORKERS);
+	~Server();
+
+	//serve clients until SIGINT or SIGTERM
+	void run();
+};
+
+#endif
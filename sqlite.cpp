@@ -1,4 +1,6 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <cstring>
 
@@ -7,6 +9,8 @@
 #include "node.hpp"
 #include "row.hpp"
 #include "statement.hpp"
+#include "result_sink.hpp"
+#include "server.hpp"
 
 enum MetaCommandResult {
 	CommandSuccess,
@@ -19,20 +23,84 @@ void print_constants() {
 	std::cout << "ROW_SIZE: " << Row::ROW_SIZE << std::endl;
 	std::cout << "COMMON_NODE_HEADER_SIZE: " << COMMON_NODE_HEADER_SIZE << std::endl;
 	std::cout << "LEAF_NODE_HEADER_SIZE: " << LEAF_NODE_HEADER_SIZE << std::endl;
-	std::cout << "LEAF_NODE_CELL_SIZE: " << LEAF_NODE_CELL_SIZE << std::endl;
+	std::cout << "LEAF_NODE_SLOT_SIZE: " << LEAF_NODE_SLOT_SIZE << std::endl;
+	std::cout << "RECORD_MAX_SIZE: " << Row::RECORD_MAX_SIZE << std::endl;
 	std::cout << "LEAF_NODE_SPACE_FOR_CELLS: " << LEAF_NODE_SPACE_FOR_CELLS << std::endl;
-	std::cout << "LEAF_NODE_MAX_CELLS: " << LEAF_NODE_MAX_CELLS << std::endl;
 }
 
 void print_leaf_node(char *node) {
 	uint32_t numCells = *(leaf_node_num_cells(node));
 	std::cout<<"leaf (size " << numCells << ")" << std::endl;
 	for (uint32_t i = 0; i < numCells; ++i) {
-		uint32_t key = *leaf_node_key(node, i);
+		uint32_t key = leaf_node_key(node, i);
 		std::cout<<"  - " << i << " : " << key << std::endl;
 	}
 }
 
+/*
+ * Rows for .load, one "id username email" line per row
+ */
+class FileRowSource : public RowSource {
+	std::ifstream in;
+public:
+	bool invalidRow;
+
+	explicit FileRowSource(const std::string &path) : in(path), invalidRow(false) {}
+
+	inline bool isOpen() {
+		return in.is_open();
+	}
+
+	bool next(Row &row) override {
+		long long id;
+		std::string username, email;
+		if (!(in >> id >> username >> email))
+			return false;
+
+		if (id < 0 || id > UINT32_MAX ||
+		    username.length() >= Row::USERNAME_SIZE ||
+		    email.length() >= Row::EMAIL_SIZE) {
+			invalidRow = true;
+			return false;
+		}
+
+		memset(&row, 0, sizeof(row));
+		row.id = id;
+		strcpy(row.username, username.c_str());
+		strcpy(row.email, email.c_str());
+		return true;
+	}
+};
+
+void load_file(std::string args, Table *t) {
+	std::stringstream ss(args);
+	std::string path;
+	double fillFactor = DEFAULT_BULK_FILL_FACTOR;
+	ss >> path >> fillFactor;
+
+	FileRowSource source(path);
+	if (!source.isOpen()) {
+		std::cout << "Unable to open " << path << std::endl;
+		return;
+	}
+
+	switch (t->bulkLoad(source, fillFactor)) {
+		case BulkLoadSuccess:
+			if (source.invalidRow) {
+				std::cout << "Invalid row, loading stopped before it\n";
+			} else {
+				std::cout << "Loaded\n";
+			}
+			break;
+		case BulkLoadTableNotEmpty:
+			std::cout << "Bulk load needs an empty table\n";
+			break;
+		case BulkLoadUnsorted:
+			std::cout << "Rows are not sorted by id, nothing loaded\n";
+			break;
+	}
+}
+
 /**************
 GLOBAL FUNCTIONS
 **************/
@@ -41,7 +109,7 @@ inline static void printPrompt() {
 	std::cout << "db > ";
 }
 
-MetaCommandResult runCommand(std::string input, Table *t) {
+MetaCommandResult runCommand(std::string input, Table *t, ResultSink &sink) {
 	if (input == ".exit") {
 		t->dbClose();
 		delete t;
@@ -51,7 +119,27 @@ MetaCommandResult runCommand(std::string input, Table *t) {
 		return MetaCommandResult::CommandSuccess;
 	} else if (input == ".btree") {
 		std::cout<<"Tree: " << std::endl;
-		t->print(0, 0);
+		t->print(t->getRootPageNum(), 0);
+		return MetaCommandResult::CommandSuccess;
+	} else if (input.compare(0, 6, ".mode ") == 0) {
+		std::string name = input.substr(6);
+		OutputMode mode;
+		if (parse_output_mode(name, mode)) {
+			sink.setMode(mode);
+		} else {
+			std::cout << "Unknown mode " << name << ", use table, csv, tsv or binary\n";
+		}
+		return MetaCommandResult::CommandSuccess;
+	} else if (input == ".vacuum") {
+		uint32_t before = t->getPager()->getNumOfPages();
+		t->vacuum();
+		std::cout << "Vacuumed " << before << " pages into " << t->getPager()->getNumOfPages() << "\n";
+		return MetaCommandResult::CommandSuccess;
+	} else if (input == ".stats") {
+		t->printStats(std::cout, true);
+		return MetaCommandResult::CommandSuccess;
+	} else if (input.compare(0, 6, ".load ") == 0) {
+		load_file(input.substr(6), t);
 		return MetaCommandResult::CommandSuccess;
 	} else {
 		return MetaCommandResult::CommandUnrecognized;
@@ -65,53 +153,91 @@ int main(int argc, char *argv[]) {
 		std::cout << "2nd arg not provided.\n";
 		return 1;
 	}
+
+	PagerOptions options;
+	//serve the table on this socket instead of reading stdin
+	std::string listenPath;
+	uint32_t numOfWorkers = DEFAULT_SERVER_WORKERS;
+	//append the stats to this file every statsIntervalMs
+	std::string statsPath;
+	uint32_t statsIntervalMs = DEFAULT_STATS_INTERVAL_MS;
+	for (int i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			options.maxFrames = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--flush-interval") == 0 && i + 1 < argc) {
+			options.flushIntervalMs = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--flush-batch") == 0 && i + 1 < argc) {
+			options.flushBatchPages = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--read-ahead") == 0 && i + 1 < argc) {
+			options.readAheadPages = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--mmap") == 0) {
+			options.mode = PagerMode::Mmap;
+		} else if (strcmp(argv[i], "--compress") == 0) {
+			options.compress = true;
+		} else if (strcmp(argv[i], "--direct") == 0) {
+			options.direct = true;
+		} else if (strcmp(argv[i], "--wal") == 0) {
+			options.wal.enabled = true;
+		} else if (strcmp(argv[i], "--group-commit") == 0 && i + 1 < argc) {
+			options.wal.groupCommitSize = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--commit-window") == 0 && i + 1 < argc) {
+			options.wal.groupCommitWindowMs = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+			options.wal.checkpointFrames = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+			listenPath = argv[++i];
+		} else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+			numOfWorkers = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--stats-file") == 0 && i + 1 < argc) {
+			statsPath = argv[++i];
+		} else if (strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+			statsIntervalMs = strtoul(argv[++i], nullptr, 10);
+		} else {
+			std::cout << "Unknown option " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+
 	std::string input;
 	Table *table = new Table;
-	table->dbOpen(argv[1]);
+	if (!listenPath.empty()) {
+		Server server(table, listenPath, numOfWorkers);
+		table->dbOpen(argv[1], options);
+		if (!statsPath.empty()) {
+			table->startStatsDump(statsPath, statsIntervalMs);
+		}
+		server.run();
+		table->dbClose();
+		delete table;
+		return 0;
+	}
+
+	table->dbOpen(argv[1], options);
+	if (!statsPath.empty()) {
+		table->startStatsDump(statsPath, statsIntervalMs);
+	}
+	//reused, so preparing a statement doesn't allocate
+	Statement st;
+	ResultSink sink(std::cout);
 
 	while(true) {
 		printPrompt();
-		getline(std::cin, input);
+		if (!getline(std::cin, input)) {
+			//end of input closes the database like .exit
+			input = ".exit";
+		}
 
 		if (input[0] == '.') {
-			switch(runCommand(input, table)) {
+			switch(runCommand(input, table, sink)) {
 				case MetaCommandResult::CommandSuccess:
-				break;
+				continue;
 				case MetaCommandResult::CommandUnrecognized:
 				std::cout << "Unrecognized command!\n";
                 continue;
 			}
 		}
 
-		Statement st;
-		auto prepareResult = st.prepareStatement(input);
-		switch(prepareResult) {
-			case PrepareSuccess:
-				break;
-			case PrepareSyntaxError:
-				std::cout << "Syntax error. Could not parse statement.\n";
-                continue;
-			case PrepareStringTooLong:
-				std::cout << "String too long\n";
-                continue;
-			case PrepareNegativeId:
-				std::cout << "Negative Id not allowed!\n";
-				continue;
-			case PrepareUnrecognized:
-				std::cout << "Unrecognized Statement in " << input << std::endl;
-				continue;
-		}
-
-		switch(st.executeStatement(table)) {
-			case ExecuteSucess:
-				std::cout << "Executed\n";
-				break;
-			case ExecuteDuplicateKey:
-				std::cout << "Duplicate keys not allowed\n";
-				break;
-			case ExecuteTableFull:
-				break;
-		}
+		st.run(input, table, sink, std::cout);
 	}
 
 	return 0;
@@ -1,101 +1,504 @@
-#include <vector>
-#include <string>
-#include <sstream>
 #include <cstring>
+#include <charconv>
+#include <algorithm>
+#include <chrono>
 
 #include "statement.hpp"
 #include "table.hpp"
 #include "node.hpp"
 #include "cursor.hpp"
+#include "result_sink.hpp"
+#include "stats.hpp"
 
-PrepareResult Statement::prepareInsert(std::string str) {
-	std::stringstream ss(str);
-	std::string token;
-	std::vector<std::string> tokens;
-	tokens.reserve(4);
-	std::string keyword, id, username, email;
-	while (getline(ss, token, ' ')) {
-		tokens.push_back(token);
-	}
-	if (tokens.size() != 4)
-		return PrepareSyntaxError;
+static_assert(StatementType::Update + 1 == STATS_STATEMENT_TYPES, "one latency histogram per statement type");
 
-       std::string cpp;
-	try {
-		rowToInsert.id = stoi(tokens[1]);
-	} catch(...) {
-		return PrepareSyntaxError;
-	}
+/**
+ * @brief copy a word into a fixed size, NUL terminated column
+ * @return false if it doesn't fit
+ */
+static bool copy_column(char *dest, size_t size, std::string_view word) {
+	if (word.size() >= size)
+		return false;
+	memcpy(dest, word.data(), word.size());
+	memset(dest + word.size(), 0, size - word.size());
+	return true;
+}
 
-	if (stoi(tokens[1]) < 0) {
+/**
+ * @brief parse a non-negative 32 bit number token
+ */
+PrepareResult Statement::parseId(Lexer &lexer, uint32_t &id) {
+	const Token &token = lexer.peek();
+	if (token.type != TokenType::Number)
+		return syntaxError(token);
+	if (token.text[0] == '-')
 		return PrepareNegativeId;
+
+	auto result = std::from_chars(token.text.data(), token.text.data() + token.text.size(), id);
+	if (result.ec != std::errc() || result.ptr != token.text.data() + token.text.size())
+		return syntaxError(token);
+	lexer.next();
+	return PrepareSuccess;
+}
+
+/**
+ * @brief tuple := NUMBER WORD WORD
+ */
+PrepareResult Statement::prepareTuple(Lexer &lexer) {
+	Row &row = rowsToInsert.emplace_back();
+
+	PrepareResult result = parseId(lexer, row.id);
+	if (result != PrepareSuccess)
+		return result;
+
+	for (int column = 0; column < 2; ++column) {
+		const Token &token = lexer.peek();
+		if (token.type != TokenType::Word && token.type != TokenType::Number)
+			return syntaxError(token);
+
+		bool fits = (column == 0)
+			? copy_column(row.username, Row::USERNAME_SIZE, token.text)
+			: copy_column(row.email, Row::EMAIL_SIZE, token.text);
+		if (!fits)
+			return PrepareStringTooLong;
+		lexer.next();
 	}
+	return PrepareSuccess;
+}
+
+/**
+ * @brief insert := 'insert' tuple (',' tuple)*
+ */
+PrepareResult Statement::prepareInsert(Lexer &lexer) {
+	type = Insert;
+	do {
+		PrepareResult result = prepareTuple(lexer);
+		if (result != PrepareSuccess)
+			return result;
+	} while (lexer.accept(TokenType::Comma));
+
+	return PrepareSuccess;
+}
 
-	if (tokens[2].length() < 32) {
-		strcpy(rowToInsert.username, tokens[2].c_str());
+/**
+ * @brief column := 'username' | 'email'
+ */
+PrepareResult Statement::prepareColumn(Lexer &lexer) {
+	if (lexer.acceptKeyword("username")) {
+		column = IndexColumn::Username;
+	} else if (lexer.acceptKeyword("email")) {
+		column = IndexColumn::Email;
 	} else {
-		return PrepareStringTooLong;
+		return syntaxError(lexer.peek());
 	}
+	return PrepareSuccess;
+}
 
-	if (tokens[3].length() < 64) {
-		strcpy(rowToInsert.email, tokens[3].c_str());
-	} else {
-		return PrepareStringTooLong;
+/**
+ * @brief predicate := 'id' ('=' | '<' | '<=' | '>' | '>=') NUMBER
+ *                   | 'id' 'between' NUMBER 'and' NUMBER
+ *                   | column '=' WORD
+ * @details narrows the inclusive range [low, high] to the keys
+ * matching the predicate. At most one predicate may be on a column.
+ */
+PrepareResult Statement::preparePredicate(Lexer &lexer, int64_t &low, int64_t &high) {
+	PrepareResult result;
+	if (!lexer.acceptKeyword("id")) {
+		if (byColumn)
+			return syntaxError(lexer.peek());
+		if ((result = prepareColumn(lexer)) != PrepareSuccess)
+			return result;
+		if (!lexer.accept(TokenType::Equal))
+			return syntaxError(lexer.peek());
+
+		const Token &token = lexer.peek();
+		if (token.type != TokenType::Word && token.type != TokenType::Number)
+			return syntaxError(token);
+		if (!copy_column(lookupValue, INDEX_COLUMN_SIZE[(uint32_t)column], token.text))
+			return PrepareStringTooLong;
+		lexer.next();
+		byColumn = true;
+		return PrepareSuccess;
+	}
+
+	uint32_t value;
+	if (lexer.acceptKeyword("between")) {
+		uint32_t upper;
+		if ((result = parseId(lexer, value)) != PrepareSuccess)
+			return result;
+		if (!lexer.acceptKeyword("and"))
+			return syntaxError(lexer.peek());
+		if ((result = parseId(lexer, upper)) != PrepareSuccess)
+			return result;
+		low = std::max(low, (int64_t)value);
+		high = std::min(high, (int64_t)upper);
+		return PrepareSuccess;
+	}
+
+	TokenType op = lexer.peek().type;
+	switch (op) {
+		case TokenType::Equal:
+		case TokenType::Less:
+		case TokenType::LessEqual:
+		case TokenType::Greater:
+		case TokenType::GreaterEqual:
+			lexer.next();
+			break;
+		default:
+			return syntaxError(lexer.peek());
 	}
+	if ((result = parseId(lexer, value)) != PrepareSuccess)
+		return result;
 
+	if (op == TokenType::Equal || op == TokenType::Greater || op == TokenType::GreaterEqual)
+		low = std::max(low, (int64_t)value + (op == TokenType::Greater));
+	if (op == TokenType::Equal || op == TokenType::Less || op == TokenType::LessEqual)
+		high = std::min(high, (int64_t)value - (op == TokenType::Less));
 	return PrepareSuccess;
 }
 
-PrepareResult Statement::prepareStatement(std::string st) {
-	if (strncmp(st.c_str(), "insert", 6) == 0) {
-		type = Insert;
-		return prepareInsert(st);
-	}
-	if (st == "select") {
-		type = Select;
+/**
+ * @brief select := 'select' where
+ */
+PrepareResult Statement::prepareSelect(Lexer &lexer) {
+	type = Select;
+	return prepareWhere(lexer);
+}
+
+/**
+ * @brief where := ['where' predicate ('and' predicate)*]
+ * @details The predicates are folded into one key range, executed as
+ * a seek to its first key and a walk of the leaves up to its last.
+ */
+PrepareResult Statement::prepareWhere(Lexer &lexer) {
+	if (!lexer.acceptKeyword("where"))
 		return PrepareSuccess;
+
+	int64_t low = 0;
+	int64_t high = UINT32_MAX;
+	do {
+		PrepareResult result = preparePredicate(lexer, low, high);
+		if (result != PrepareSuccess)
+			return result;
+	} while (lexer.acceptKeyword("and"));
+
+	if (low > high) {
+		//nothing can match, an empty range the executor skips
+		selectFrom = 1;
+		selectTo = 0;
+	} else {
+		selectFrom = low;
+		selectTo = high;
+	}
+	return PrepareSuccess;
+}
+
+/**
+ * @brief create := 'create' 'index' 'on' column
+ */
+PrepareResult Statement::prepareCreateIndex(Lexer &lexer) {
+	type = CreateIndex;
+	if (!lexer.acceptKeyword("index"))
+		return syntaxError(lexer.peek());
+	if (!lexer.acceptKeyword("on"))
+		return syntaxError(lexer.peek());
+	return prepareColumn(lexer);
+}
+
+/**
+ * @brief delete := 'delete' where
+ */
+PrepareResult Statement::prepareDelete(Lexer &lexer) {
+	type = Delete;
+	return prepareWhere(lexer);
+}
+
+/**
+ * @brief update := 'update' 'set' assignment (',' assignment)* where
+ */
+PrepareResult Statement::prepareUpdate(Lexer &lexer) {
+	type = Update;
+	if (!lexer.acceptKeyword("set"))
+		return syntaxError(lexer.peek());
+	do {
+		PrepareResult result = prepareAssignment(lexer);
+		if (result != PrepareSuccess)
+			return result;
+	} while (lexer.accept(TokenType::Comma));
+	return prepareWhere(lexer);
+}
+
+/**
+ * @brief assignment := column '=' WORD
+ */
+PrepareResult Statement::prepareAssignment(Lexer &lexer) {
+	PrepareResult result = prepareColumn(lexer);
+	if (result != PrepareSuccess)
+		return result;
+	if (!lexer.accept(TokenType::Equal))
+		return syntaxError(lexer.peek());
+
+	const Token &token = lexer.peek();
+	if (token.type != TokenType::Word && token.type != TokenType::Number)
+		return syntaxError(token);
+	bool fits;
+	if (column == IndexColumn::Username) {
+		fits = copy_column(newUsername, Row::USERNAME_SIZE, token.text);
+		setsUsername = true;
+	} else {
+		fits = copy_column(newEmail, Row::EMAIL_SIZE, token.text);
+		setsEmail = true;
+	}
+	if (!fits)
+		return PrepareStringTooLong;
+	lexer.next();
+	return PrepareSuccess;
+}
+
+PrepareResult Statement::syntaxError(const Token &token) {
+	errorPos = token.pos;
+	return PrepareSyntaxError;
+}
+
+/**
+ * @brief parse st into this statement
+ * @details The input is only viewed, never copied, and a reused
+ * statement keeps the capacity of its row buffer, so preparing
+ * does not allocate.
+ */
+PrepareResult Statement::prepareStatement(std::string_view st) {
+	rowsToInsert.clear();
+	selectFrom = 0;
+	selectTo = UINT32_MAX;
+	byColumn = false;
+	setsUsername = false;
+	setsEmail = false;
+	errorPos = 0;
+
+	Lexer lexer(st);
+	PrepareResult result;
+	if (lexer.acceptKeyword("insert")) {
+		result = prepareInsert(lexer);
+	} else if (lexer.acceptKeyword("select")) {
+		result = prepareSelect(lexer);
+	} else if (lexer.acceptKeyword("create")) {
+		result = prepareCreateIndex(lexer);
+	} else if (lexer.acceptKeyword("delete")) {
+		result = prepareDelete(lexer);
+	} else if (lexer.acceptKeyword("update")) {
+		result = prepareUpdate(lexer);
+	} else if (lexer.acceptKeyword("begin")) {
+		type = Begin;
+		result = PrepareSuccess;
+	} else if (lexer.acceptKeyword("commit")) {
+		type = Commit;
+		result = PrepareSuccess;
+	} else {
+		return PrepareUnrecognized;
 	}
 
-	return PrepareUnrecognized;
+	if (result == PrepareSuccess && lexer.peek().type != TokenType::End) {
+		return syntaxError(lexer.peek());
+	}
+	return result;
 }
 
+/**
+ * @brief insert the rows in order. An id that is already taken, or
+ * one that comes twice in the list, inserts none of the rows.
+ */
 ExecuteResult Statement::executeInsert(Table *t) {
-	uint32_t keyToInsert = rowToInsert.id;
-	Cursor *c = t->tableFind(keyToInsert);
+	bool inserted = t->insertRows(rowsToInsert.data(), rowsToInsert.size());
+	t->finishStatement(this);
+	if (!inserted)
+		return ExecuteDuplicateKey;
+
+	return ExecuteSucess;
+}
+
+/**
+ * @brief call visit with the record of every row the where clause
+ * matches, in id order, all read through one snapshot
+ * @details A column predicate goes through the index of the column if
+ * it has one, else it is checked on every row of the id range.
+ */
+template <typename Visit>
+void Statement::forEachMatch(Table *t, Visit visit) {
+	if (selectFrom > selectTo)
+		return;
 
-	char *node = t->getPager()->getPage(c->pageNum);
-	uint32_t numOfCells = *(leaf_node_num_cells(node));
+	std::string_view value(lookupValue, strnlen(lookupValue, INDEX_COLUMN_SIZE[(uint32_t)column]));
+	//the leaves the cursors read, one at a time
+	char *copy = static_cast<char *>(scratch.allocate(PAGE_SIZE));
+	uint64_t snapshot = t->openSnapshot();
+	if (byColumn && t->hasIndex(column)) {
+		lookupIds.clear();
+		t->indexLookup(column, value, lookupIds);
+		//the index is newer than the snapshot: rows that held the value
+		//for it may have been deleted or changed since. Every write to the
+		//index after the snapshot is in the versions by now.
+		t->olderVersions(snapshot, selectFrom, selectTo, olderRows);
+		for (const RowVersion &older : olderRows) {
+			if (older.existed && record_column(view_record(older.record.data()), column) == value) {
+				lookupIds.push_back(older.key);
+			}
+		}
+		std::sort(lookupIds.begin(), lookupIds.end());
+		lookupIds.erase(std::unique(lookupIds.begin(), lookupIds.end()), lookupIds.end());
+		for (uint32_t id : lookupIds) {
+			if (id < selectFrom || id > selectTo)
+				continue;
+			Cursor c = t->snapshotSeek(id, snapshot, copy);
+			//rows the index gained since may have held another value
+			if (!c.endOfTable && c.key() == id &&
+			    record_column(view_record(c.value()), column) == value) {
+				visit(c.value());
+			}
+		}
+		t->closeSnapshot(snapshot);
+		return;
+	}
 
-	if (c->cellNum < numOfCells) {
-		uint32_t keyAtIndex = *leaf_node_key(node, c->cellNum);
-		if (keyAtIndex == keyToInsert) {
-			return ExecuteDuplicateKey;
+	//one descent to the first key, then walk the leaf chain
+	{
+		Cursor c = t->snapshotSeek(selectFrom, snapshot, copy);
+		while (!c.endOfTable) {
+			uint32_t key = c.key();
+			if (key > selectTo)
+				break;
+			if (!byColumn || record_column(view_record(c.value()), column) == value) {
+				visit(c.value());
+			}
+			//don't step into the next leaf once the last key in range is out
+			if (key == selectTo)
+				break;
+			c.advance();
 		}
 	}
+	t->closeSnapshot(snapshot);
+}
 
-	t->leafNodeInsert(c, rowToInsert.id, &rowToInsert);
-	delete c;
+ExecuteResult Statement::executeSelect(Table *t, ResultSink &sink) {
+	//formatted from the cell, no Row in between
+	forEachMatch(t, [&sink](const char *record) {
+		sink.writeRow(record);
+	});
+	sink.flush();
+	return ExecuteSucess;
+}
 
+/**
+ * @brief the matching rows are collected first, through a snapshot,
+ * then deleted one by one
+ */
+ExecuteResult Statement::executeDelete(Table *t) {
+	matchedIds.clear();
+	forEachMatch(t, [this](const char *record) {
+		matchedIds.push_back(view_record(record).id);
+	});
+	for (uint32_t id : matchedIds) {
+		t->deleteRow(id);
+	}
+	t->finishStatement(this);
 	return ExecuteSucess;
 }
 
-ExecuteResult Statement::executeSelect(Table *t) {
-		Row r;
-		Cursor *c = t->tableStart();
-		for (int i = 0; i < t->rows(); ++i) {
-			r.deserialize(c->value());
-			r.print();
-			c->advance();
-		}
-		delete c;
-		return ExecuteSucess;
+ExecuteResult Statement::executeUpdate(Table *t) {
+	matchedIds.clear();
+	forEachMatch(t, [this](const char *record) {
+		matchedIds.push_back(view_record(record).id);
+	});
+	for (uint32_t id : matchedIds) {
+		t->updateRow(id, setsUsername ? newUsername : nullptr, setsEmail ? newEmail : nullptr);
 	}
+	t->finishStatement(this);
+	return ExecuteSucess;
+}
 
-ExecuteResult Statement::executeStatement(Table *t) {
+ExecuteResult Statement::executeStatement(Table *t, ResultSink &sink) {
+	auto start = std::chrono::steady_clock::now();
+	scratch.reset();
+	ExecuteResult result = executeType(t, sink);
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	stats.statements[type].record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	return result;
+}
+
+/**
+ * @brief a transaction belongs to the statement object that began it,
+ * one per connection, writes of the others are refused until it commits
+ */
+ExecuteResult Statement::executeType(Table *t, ResultSink &sink) {
+	bool writes = type == Insert || type == Delete || type == Update || type == CreateIndex;
+	if (writes && !t->startStatement(this))
+		return ExecuteTransactionBusy;
 	switch(type) {
 		case Insert:
 			return executeInsert(t);
 		case Select:
-			return executeSelect(t);
+			return executeSelect(t, sink);
+		case Begin:
+			if (!t->begin(this))
+				return ExecuteTransactionActive;
+			return ExecuteSucess;
+		case Commit:
+			if (!t->commit(this))
+				return ExecuteNoTransaction;
+			return ExecuteSucess;
+		case CreateIndex: {
+			bool created = t->createIndex(column);
+			t->finishStatement(this);
+			if (!created)
+				return ExecuteIndexExists;
+			return ExecuteSucess;
+		}
+		case Delete:
+			return executeDelete(t);
+		case Update:
+			return executeUpdate(t);
+	}
+	return ExecuteSucess;
+}
+
+void Statement::run(std::string_view input, Table *t, ResultSink &sink, std::ostream &out) {
+	switch(prepareStatement(input)) {
+		case PrepareSuccess:
+			break;
+		case PrepareSyntaxError:
+			out << "Syntax error at column " << getErrorPos() + 1
+			    << ". Could not parse statement.\n";
+			return;
+		case PrepareStringTooLong:
+			out << "String too long\n";
+			return;
+		case PrepareNegativeId:
+			out << "Negative Id not allowed!\n";
+			return;
+		case PrepareUnrecognized:
+			out << "Unrecognized Statement in " << input << std::endl;
+			return;
 	}
-}
\ No newline at end of file
+
+	switch(executeStatement(t, sink)) {
+		case ExecuteSucess:
+			out << "Executed\n";
+			break;
+		case ExecuteDuplicateKey:
+			out << "Duplicate keys not allowed\n";
+			break;
+		case ExecuteTransactionActive:
+			out << "A transaction is already active\n";
+			break;
+		case ExecuteNoTransaction:
+			out << "No transaction is active\n";
+			break;
+		case ExecuteTransactionBusy:
+			out << "Another connection has a transaction active\n";
+			break;
+		case ExecuteIndexExists:
+			out << "Index already exists\n";
+			break;
+		case ExecuteTableFull:
+			break;
+	}
+}
@@ -1,15 +1,28 @@
 #ifndef STATEMENT_H
 #define STATEMENT_H
 
-#include <string>
+#include <string_view>
+#include <ostream>
+#include <vector>
+#include <stdint.h>
 #include "row.hpp"
+#include "lexer.hpp"
+#include "index.hpp"
+#include "arena.hpp"
+#include "version_store.hpp"
 
 class Table;
+class ResultSink;
 
 enum ExecuteResult {
 	ExecuteSucess,
 	ExecuteTableFull,
-	ExecuteDuplicateKey
+	ExecuteDuplicateKey,
+	ExecuteTransactionActive,
+	ExecuteNoTransaction,
+	//writes while another connection's transaction is active
+	ExecuteTransactionBusy,
+	ExecuteIndexExists
 };
 
 enum PrepareResult {
@@ -23,24 +36,88 @@ enum PrepareResult {
 
 enum StatementType {
 	Insert,
-	Select
+	Select,
+	Begin,
+	Commit,
+	CreateIndex,
+	Delete,
+	Update
 };
 
 class Statement {
 	StatementType type;
-	Row rowToInsert;
+	std::vector<Row> rowsToInsert;
+	//inclusive key range streamed by select
+	uint32_t selectFrom;
+	uint32_t selectTo;
+	//select restricted to rows whose column equals lookupValue,
+	//also the column of create index
+	bool byColumn;
+	IndexColumn column;
+	char lookupValue[Row::EMAIL_SIZE];
+	//ids found in the index, reused between statements
+	std::vector<uint32_t> lookupIds;
+	//what the snapshot of an index lookup sees of rows written after it
+	std::vector<RowVersion> olderRows;
+	//rows a delete or update changes, reused between statements
+	std::vector<uint32_t> matchedIds;
+	//new values of the columns an update sets
+	bool setsUsername;
+	bool setsEmail;
+	char newUsername[Row::USERNAME_SIZE];
+	char newEmail[Row::EMAIL_SIZE];
+	//offset of the token a syntax error was found at
+	size_t errorPos;
+	//memory for the execution of one statement, reset by executeStatement()
+	Arena scratch;
+
+	PrepareResult syntaxError(const Token &token);
+	PrepareResult parseId(Lexer &lexer, uint32_t &id);
+	PrepareResult prepareTuple(Lexer &lexer);
+	PrepareResult preparePredicate(Lexer &lexer, int64_t &low, int64_t &high);
+	PrepareResult prepareColumn(Lexer &lexer);
+	PrepareResult prepareWhere(Lexer &lexer);
+	PrepareResult prepareAssignment(Lexer &lexer);
+	template <typename Visit>
+	void forEachMatch(Table *t, Visit visit);
+
 public:
-	Statement() {}
+	Statement() : selectFrom(0), selectTo(UINT32_MAX), byColumn(false),
+	              column(IndexColumn::Username), setsUsername(false),
+	              setsEmail(false), errorPos(0) {}
+
+	PrepareResult prepareInsert(Lexer &lexer);
+
+	PrepareResult prepareSelect(Lexer &lexer);
+
+	PrepareResult prepareCreateIndex(Lexer &lexer);
+
+	PrepareResult prepareDelete(Lexer &lexer);
 
-	PrepareResult prepareInsert(std::string str);
+	PrepareResult prepareUpdate(Lexer &lexer);
 
-	PrepareResult prepareStatement(std::string st);
+	PrepareResult prepareStatement(std::string_view st);
+
+	inline size_t getErrorPos() {
+		return errorPos;
+	}
 
 	ExecuteResult executeInsert(Table *t);
 
-	ExecuteResult executeSelect(Table *t);
+	ExecuteResult executeSelect(Table *t, ResultSink &sink);
+
+	ExecuteResult executeDelete(Table *t);
+
+	ExecuteResult executeUpdate(Table *t);
+
+	ExecuteResult executeType(Table *t, ResultSink &sink);
+
+	//execute and record the latency under the statement's type, see Stats
+	ExecuteResult executeStatement(Table *t, ResultSink &sink);
 
-	ExecuteResult executeStatement(Table *t);
+	//prepare and execute input the way the shell does: rows go to
+	//sink, "Executed" or why the statement failed goes to out
+	void run(std::string_view input, Table *t, ResultSink &sink, std::ostream &out);
 
 };
 
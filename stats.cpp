@@ -0,0 +1,147 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <ctime>
+
+#include "stats.hpp"
+#include "table.hpp"
+
+Stats stats;
+
+//in the order of StatementType
+static const char *STATEMENT_NAMES[STATS_STATEMENT_TYPES] = {
+	"insert", "select", "begin", "commit", "create index", "delete", "update"
+};
+
+LatencyHistogram::LatencyHistogram() {
+    for (std::atomic<uint64_t> &bucket : buckets) {
+        bucket = 0;
+    }
+    count = 0;
+    totalNs = 0;
+}
+
+/**
+ * @brief values below STATS_SUB_BUCKETS get a bucket each, above that
+ * the highest bit picks the power of two and the bits after it the
+ * bucket within
+ */
+uint32_t LatencyHistogram::bucketOf(uint64_t ns) {
+	if (ns < STATS_SUB_BUCKETS)
+		return ns;
+	uint32_t highBit = 63 - __builtin_clzll(ns);
+	uint32_t sub = (ns >> (highBit - STATS_SUB_BUCKET_BITS)) & (STATS_SUB_BUCKETS - 1);
+	return (highBit - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS + sub;
+}
+
+/**
+ * @brief the largest value that falls into bucket
+ */
+uint64_t LatencyHistogram::bucketLimit(uint32_t bucket) {
+	if (bucket < STATS_SUB_BUCKETS)
+		return bucket;
+	uint32_t highBit = bucket / STATS_SUB_BUCKETS + STATS_SUB_BUCKET_BITS - 1;
+	uint64_t sub = bucket % STATS_SUB_BUCKETS;
+	uint64_t low = (STATS_SUB_BUCKETS + sub) << (highBit - STATS_SUB_BUCKET_BITS);
+	return low + (1ull << (highBit - STATS_SUB_BUCKET_BITS)) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(double q) {
+	uint64_t total = 0;
+	uint64_t counts[STATS_NUM_BUCKETS];
+	for (uint32_t i = 0; i < STATS_NUM_BUCKETS; ++i) {
+		counts[i] = buckets[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+	if (total == 0)
+		return 0;
+
+	uint64_t rank = q * total;
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < STATS_NUM_BUCKETS; ++i) {
+		seen += counts[i];
+		if (seen > rank)
+			return bucketLimit(i);
+	}
+	return bucketLimit(STATS_NUM_BUCKETS - 1);
+}
+
+Stats::Stats() {
+    for (std::atomic<uint64_t> *counter : {&pageHits, &pageMisses, &bytesRead, &bytesWritten, &flushes,
+                                           &leafSplits, &internalSplits, &leafMerges, &internalMerges}) {
+        *counter = 0;
+    }
+}
+
+void print_counters(std::ostream &out) {
+	auto get = [](std::atomic<uint64_t> &counter) {
+		return counter.load(std::memory_order_relaxed);
+	};
+	uint64_t hits = get(stats.pageHits);
+	uint64_t misses = get(stats.pageMisses);
+	out << "pager: hits " << hits << ", misses " << misses;
+	if (hits + misses > 0) {
+		out << ", hit ratio " << (double)hits / (hits + misses);
+	}
+	out << "\n";
+	out << "io: bytes read " << get(stats.bytesRead) << ", bytes written " << get(stats.bytesWritten)
+	    << ", flushes " << get(stats.flushes) << "\n";
+	out << "splits: leaf " << get(stats.leafSplits) << ", internal " << get(stats.internalSplits) << "\n";
+	out << "merges: leaf " << get(stats.leafMerges) << ", internal " << get(stats.internalMerges) << "\n";
+
+	for (uint32_t i = 0; i < STATS_STATEMENT_TYPES; ++i) {
+		LatencyHistogram &histogram = stats.statements[i];
+		uint64_t n = histogram.getCount();
+		if (n == 0)
+			continue;
+		out << STATEMENT_NAMES[i] << ": count " << n
+		    << ", mean ns " << histogram.getTotalNs() / n
+		    << ", p50 ns " << histogram.percentile(0.5)
+		    << ", p99 ns " << histogram.percentile(0.99)
+		    << ", p999 ns " << histogram.percentile(0.999) << "\n";
+	}
+}
+
+StatsDumper::StatsDumper(Table *table, const std::string &path, uint32_t intervalMs)
+    : table(table), path(path), intervalMs(intervalMs), stopping(false) {
+    thread = std::thread(&StatsDumper::loop, this);
+}
+
+StatsDumper::~StatsDumper() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	thread.join();
+	dump();
+}
+
+void StatsDumper::loop() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping) {
+		wake.wait_for(lock, std::chrono::milliseconds(intervalMs));
+		if (stopping)
+			break;
+		lock.unlock();
+		dump();
+		lock.lock();
+	}
+}
+
+/**
+ * @brief append the stats to the file, without the fill of the nodes:
+ * walking every node would push the working set out of the pool
+ */
+void StatsDumper::dump() {
+	std::ofstream out(path, std::ios::app);
+	if (!out) {
+		std::cout << "Unable to write stats to " << path << std::endl;
+		return;
+	}
+	std::time_t now = std::time(nullptr);
+	char time[32];
+	std::strftime(time, sizeof(time), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+	out << "--- " << time << "\n";
+	table->printStats(out, false);
+}
@@ -0,0 +1,117 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <ostream>
+
+class Table;
+
+//a power of two of nanoseconds is split into this many buckets
+static constexpr uint32_t STATS_SUB_BUCKET_BITS = 2;
+static constexpr uint32_t STATS_SUB_BUCKETS = 1 << STATS_SUB_BUCKET_BITS;
+static constexpr uint32_t STATS_NUM_BUCKETS = (64 - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS;
+//kinds of statements with a histogram, one per StatementType
+static constexpr uint32_t STATS_STATEMENT_TYPES = 7;
+//how often the dump thread appends to its file by default
+static constexpr uint32_t DEFAULT_STATS_INTERVAL_MS = 10000;
+
+/*
+ * Latencies in buckets that grow with the value, each power of two
+ * split into STATS_SUB_BUCKETS, so a percentile is off by at most a
+ * quarter. Recording is one relaxed increment, any thread may record
+ * while another reads.
+ */
+class LatencyHistogram {
+	std::atomic<uint64_t> buckets[STATS_NUM_BUCKETS];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> totalNs;
+
+	static uint32_t bucketOf(uint64_t ns);
+	static uint64_t bucketLimit(uint32_t bucket);
+
+public:
+	LatencyHistogram();
+
+	inline void record(uint64_t ns) {
+		buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+		count.fetch_add(1, std::memory_order_relaxed);
+		totalNs.fetch_add(ns, std::memory_order_relaxed);
+	}
+
+	inline uint64_t getCount() {
+		return count.load(std::memory_order_relaxed);
+	}
+
+	inline uint64_t getTotalNs() {
+		return totalNs.load(std::memory_order_relaxed);
+	}
+
+	//upper bound of the bucket holding the q-th latency, q in [0, 1]
+	uint64_t percentile(double q);
+};
+
+/*********
+ STATS
+ Counters of the whole process, bumped with relaxed atomics
+ on the paths they count: one uncontended add, no ordering,
+ so they stay on in production. Readers get each counter
+ exact, but not all of them from the same instant.
+*********/
+struct Stats {
+	//pages found in the pool, pages it had to load
+	std::atomic<uint64_t> pageHits;
+	std::atomic<uint64_t> pageMisses;
+	//bytes of the database file and the log, read and written
+	std::atomic<uint64_t> bytesRead;
+	std::atomic<uint64_t> bytesWritten;
+	//_flush() and flushAll() calls, batches of the background flusher
+	std::atomic<uint64_t> flushes;
+
+	std::atomic<uint64_t> leafSplits;
+	std::atomic<uint64_t> internalSplits;
+	std::atomic<uint64_t> leafMerges;
+	std::atomic<uint64_t> internalMerges;
+
+	LatencyHistogram statements[STATS_STATEMENT_TYPES];
+
+	Stats();
+};
+
+extern Stats stats;
+
+inline void stat_add(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+	counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+//the counters and the statement histograms, one per line
+void print_counters(std::ostream &out);
+
+/*********
+ STATS DUMPER CLASS
+ Thread appending the stats of a table to a file every
+ interval, each dump headed by the time it was taken.
+*********/
+class StatsDumper {
+	Table *table;
+	std::string path;
+	uint32_t intervalMs;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	void loop();
+	void dump();
+
+public:
+	StatsDumper(Table *table, const std::string &path, uint32_t intervalMs);
+	//writes a last dump and stops the thread
+	~StatsDumper();
+};
+
+#endif
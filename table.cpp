@@ -1,183 +1,1339 @@
 #include <iostream>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+#include <unistd.h>
 
 #include "table.hpp"
 #include "pager.hpp"
+#include "mmap_pager.hpp"
 #include "node.hpp"
 #include "cursor.hpp"
 
 Table::Table() {
-    pager = new Pager;
+    pager = nullptr;
+    transactionActive = false;
+    transactionOwner = nullptr;
+    runningStatements = 0;
+    leafHint.valid = false;
+    currentWrite = 0;
+    statsDumper = nullptr;
+    for (std::atomic<Index *> &index : indexes) {
+        index = nullptr;
+    }
 }
 
 Table::~Table() {
+    for (Index *index : indexes) {
+        delete index;
+    }
     delete pager;
 }
 
-void Table::dbOpen(std::string filename) {
+void Table::dbOpen(std::string filename, const PagerOptions &options) {
+    this->filename = filename;
+    this->options = options;
+    leafHint.valid = false;
+    if (options.mode == PagerMode::Mmap) {
+        if (options.wal.enabled) {
+            std::cout << "The write-ahead log needs the buffer pool, it can't be used with mmap.\n";
+            exit(EXIT_FAILURE);
+        }
+        if (options.compress) {
+            std::cout << "Compressed pages need the buffer pool, they can't be used with mmap.\n";
+            exit(EXIT_FAILURE);
+        }
+        if (options.direct) {
+            std::cout << "Direct I/O needs the buffer pool, it can't be used with mmap.\n";
+            exit(EXIT_FAILURE);
+        }
+        pager = new MmapPager(options);
+    } else {
+        pager = new Pager(options);
+    }
     pager->_open(filename);
-    rootPageNum = 0;
     if (pager->getNumOfPages() == 0) {
-        char *rootNode = pager->getPage(0);
+        //meta page first, the root of the table right after it
+        initialize_meta_page(pager->getPage(META_PAGE_NUM), 1);
+        pager->markDirty(META_PAGE_NUM);
+        char *rootNode = pager->getPage(1);
         initialize_leaf_node(rootNode);
 		set_node_root(rootNode, true);
+		pager->markDirty(1);
+		pager->commit();
+    } else if (*meta_magic(pager->getPage(META_PAGE_NUM)) != META_MAGIC) {
+        upgradeFile();
+    }
+    uint32_t version = *meta_version(pager->getPage(META_PAGE_NUM));
+    if (version < 1) {
+        convertLeaves();
+    }
+
+    rootPageNum = *meta_root_page(pager->getPage(META_PAGE_NUM));
+    for (uint32_t i = 0; i < NUM_INDEX_COLUMNS; ++i) {
+        uint32_t indexRoot = *meta_index_root(pager->getPage(META_PAGE_NUM), i);
+        if (indexRoot == 0)
+            continue;
+        if (version < 2) {
+            //older index nodes are rebuilt from the table, their pages are left unused
+            indexRoot = Index::create(pager);
+            *meta_index_root(pager->getPage(META_PAGE_NUM), i) = indexRoot;
+            pager->markDirty(META_PAGE_NUM);
+        }
+        indexes[i] = new Index(pager, indexRoot);
+        if (version < 2) {
+            fillIndex(indexes[i], (IndexColumn)i);
+        }
     }
+
+    if (version < META_FORMAT_VERSION) {
+        *meta_version(pager->getPage(META_PAGE_NUM)) = META_FORMAT_VERSION;
+        pager->markDirty(META_PAGE_NUM);
+        pager->commit();
+    }
+}
+
+/**
+ * @brief files without a meta page have the root of the table on
+ * page 0, move it to a new page and put the meta page in its place
+ */
+void Table::upgradeFile() {
+	uint32_t newRootPageNum = pager->getUnusedPageNum();
+	char *oldRoot = pager->pinPage(META_PAGE_NUM);
+	char *newRoot = pager->pinPage(newRootPageNum);
+	memcpy(newRoot, oldRoot, PAGE_SIZE);
+	initialize_meta_page(oldRoot, newRootPageNum);
+	//the leaves still have fixed size cells
+	*meta_version(oldRoot) = 0;
+	pager->markDirty(META_PAGE_NUM);
+	pager->markDirty(newRootPageNum);
+
+	if (get_node_type(newRoot) == NodeType::NodeInternal) {
+		uint32_t numKeys = *internal_node_num_keys(newRoot);
+		for (uint32_t i = 0; i <= numKeys; ++i) {
+			setParent(*internal_node_child(newRoot, i), newRootPageNum);
+		}
+	}
+	pager->unpinPage(newRootPageNum);
+	pager->unpinPage(META_PAGE_NUM);
+	pager->commit();
 }
 
-Cursor* Table::tableStart() {
-	Cursor *c = new Cursor;
-	c->table = this;
-	c->pageNum = rootPageNum;
-	c->cellNum = 0;
+/**
+ * @brief rewrite leaves of fixed size cells (a key and a serialized
+ * Row) as slotted pages, in place along the leaf chain
+ * @details Records are never larger than the fixed cells, so every
+ * leaf fits on its own page again.
+ */
+void Table::convertLeaves() {
+	//the old header ended where the content start is now
+	constexpr uint32_t FIXED_HEADER_SIZE = LEAF_NODE_CONTENT_START_OFFSET;
+	constexpr uint32_t FIXED_CELL_SIZE = LEAF_NODE_KEY_SIZE + Row::ROW_SIZE;
+	uint32_t pageNum = *meta_root_page(pager->getPage(META_PAGE_NUM));
+	char *node = pager->getPage(pageNum);
+	while (get_node_type(node) == NodeType::NodeInternal) {
+		pageNum = *internal_node_child(node, 0);
+		node = pager->getPage(pageNum);
+	}
 
-	char *node = pager->getPage(rootPageNum);
-	uint32_t numCells = *leaf_node_num_cells(node);
+	char copy[PAGE_SIZE];
+	char record[Row::RECORD_MAX_SIZE];
+	Row row;
+	while (pageNum != 0) {
+		node = pager->getPage(pageNum);
+		memcpy(copy, node, PAGE_SIZE);
+		initialize_leaf_node(node);
+		set_node_root(node, is_node_root(copy));
+		*node_parent(node) = *node_parent(copy);
+		*leaf_node_next_leaf(node) = *leaf_node_next_leaf(copy);
 
-	c->endOfTable = (numCells == 0);
+		uint32_t numCells = *leaf_node_num_cells(copy);
+		for (uint32_t i = 0; i < numCells; ++i) {
+			row.deserialize(copy + FIXED_HEADER_SIZE + i * FIXED_CELL_SIZE + LEAF_NODE_KEY_SIZE);
+			leaf_node_insert_cell(node, i, record, row.encode(record));
+		}
+		pager->markDirty(pageNum);
+		pageNum = *leaf_node_next_leaf(node);
+	}
+}
+
+/**
+ * @brief cell of key in the leaf, or where it would be inserted
+ */
+static uint32_t leaf_node_find_cell(char *node, uint32_t key) {
+	//Binary search
+	uint32_t minIndex = 0;
+	uint32_t onePastMaxIndex = *leaf_node_num_cells(node);
+	while (onePastMaxIndex != minIndex) {
+		uint32_t index = (onePastMaxIndex + minIndex) / 2;
+		uint32_t keyAtIndex = leaf_node_key(node, index);
+		if (key == keyAtIndex)
+			return index;
+		if (key < keyAtIndex) {
+			onePastMaxIndex = index;
+		} else {
+			minIndex = index + 1;
+		}
+	}
+	return minIndex;
+}
+
+Cursor Table::tableStart() {
+	//the leftmost leaf holds the smallest key
+	return tableSeek(0);
+}
+
+/**
+ * @brief cursor at the first key >= key, ready to walk the
+ * leaf chain in key order
+ */
+Cursor Table::tableSeek(uint32_t key) {
+	Cursor c = tableFind(key);
+	//all keys of the leaf may be smaller, then it starts in the next one
+	c.skipExhaustedLeaves();
 	return c;
 }
 
-Cursor* Table::tableFind(uint32_t key) {
-	char *rootNode = pager->getPage(rootPageNum);
+Cursor Table::tableFind(uint32_t key) {
+	uint32_t pageNum;
+	char *node = findLeaf(key, pageNum);
+	return leafNodeFind(pageNum, node, key, Latch::Shared);
+}
+
+/**
+ * @brief descend to the leaf that holds key, crabbing shared latches
+ * @returns the leaf, latched shared, and its page in pageNum
+ */
+char* Table::findLeaf(uint32_t key, uint32_t &pageNum) {
+	pageNum = rootPageNum;
+	char *node = pager->latchPage(pageNum, Latch::Shared);
+
+	while (get_node_type(node) == NodeType::NodeInternal) {
+		uint32_t childIndex = internal_node_find_child(node, key);
+		uint32_t childPageNum = *internal_node_child(node, childIndex);
+		char *child = pager->latchPage(childPageNum, Latch::Shared);
+		pager->unlatchPage(pageNum, Latch::Shared);
+		pageNum = childPageNum;
+		node = child;
+	}
+	return node;
+}
 
-	if (get_node_type(rootNode) == NodeType::NodeLeaf) {
-		return leafNodeFind(rootPageNum, key);
+/**
+ * @brief snapshot cursor at the first key >= key that snapshot sees
+ */
+Cursor Table::snapshotSeek(uint32_t key, uint64_t snapshot, char *copy) {
+	uint32_t pageNum;
+	char *node = findLeaf(key, pageNum);
+	Cursor c(this, pageNum, node, snapshot, key, copy);
+	c.skipExhaustedLeaves();
+	return c;
+}
+
+/**
+ * @brief true if node can take one more entry without splitting
+ */
+static bool node_is_safe(char *node) {
+	if (get_node_type(node) == NodeType::NodeLeaf)
+		return leaf_node_free_space(node) >= Row::RECORD_MAX_SIZE + LEAF_NODE_SLOT_SIZE;
+	return *internal_node_num_keys(node) < INTERNAL_NODE_MAX_KEYS;
+}
+
+/**
+ * @brief true if node stays filled enough for no merge after losing one entry
+ */
+static bool node_is_safe_for_delete(char *node) {
+	if (get_node_type(node) == NodeType::NodeLeaf)
+		return leaf_node_used_space(node) >= LEAF_NODE_MIN_USED + Row::RECORD_MAX_SIZE + LEAF_NODE_SLOT_SIZE;
+	return *internal_node_num_keys(node) > INTERNAL_NODE_MIN_KEYS;
+}
+
+/**
+ * @brief the writer's tableFind, the cursor holds its leaf exclusively
+ * @details Ancestors that a split of the leaf would reach stay latched
+ * in writeLatches until releaseWriteLatches(). The descent is skipped
+ * when the key falls in the range of the leaf the previous call ended
+ * in and that leaf won't split. Call with writerMutex held.
+ */
+Cursor Table::tableFindHinted(uint32_t key) {
+	if (leafHint.valid && (int64_t)key > leafHint.low && key <= leafHint.high) {
+		char *node = pager->latchPage(leafHint.pageNum, Latch::Exclusive);
+		if (node_is_safe(node))
+			return leafNodeFind(leafHint.pageNum, node, key, Latch::Exclusive);
+		pager->unlatchPage(leafHint.pageNum, Latch::Exclusive);
+	}
+	return descendExclusive(key, node_is_safe);
+}
+
+/**
+ * @brief descend to the leaf of key latching exclusively, the
+ * ancestors of the first node on the way that isSafe() are let go
+ * @details The ancestors kept are in writeLatches, root first, so its
+ * last page is the parent of the leaf if the leaf isn't safe.
+ */
+Cursor Table::descendExclusive(uint32_t key, bool (*isSafe)(char *node)) {
+	int64_t low = -1;
+	uint32_t high = UINT32_MAX;
+	uint32_t pageNum = rootPageNum;
+	char *node = pager->latchPage(pageNum, Latch::Exclusive);
+
+	while (get_node_type(node) == NodeType::NodeInternal) {
+		uint32_t numKeys = *internal_node_num_keys(node);
+		uint32_t childIndex = internal_node_find_child(node, key);
+		if (childIndex > 0) {
+			low = *internal_node_key(node, childIndex - 1);
+		}
+		if (childIndex < numKeys) {
+			high = *internal_node_key(node, childIndex);
+		}
+		uint32_t childPageNum = *internal_node_child(node, childIndex);
+		char *child = pager->latchPage(childPageNum, Latch::Exclusive);
+		writeLatches.push_back(pageNum);
+		if (isSafe(child)) {
+			releaseWriteLatches();
+		}
+		pageNum = childPageNum;
+		node = child;
+	}
+
+	leafHint = LeafHint{true, pageNum, low, high};
+	return leafNodeFind(pageNum, node, key, Latch::Exclusive);
+}
+
+void Table::releaseWriteLatches() {
+	for (uint32_t pageNum : writeLatches) {
+		pager->unlatchPage(pageNum, Latch::Exclusive);
+	}
+	writeLatches.clear();
+}
+
+/**
+ * @brief insert row under its id
+ * @return false if the id is already taken
+ */
+bool Table::insertRow(Row *row) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	return insertRowLocked(row);
+}
+
+/**
+ * @brief insert rows in order, each with the one descent of insertRow()
+ * @details A taken id, or one that comes twice, turns up in that
+ * descent; the rows of the list already in are deleted again, newest
+ * first. Holding writerMutex throughout, no other writer sees them;
+ * a snapshot opened in between may, as it may see part of a list.
+ * @return false if an id is taken or comes twice, nothing is inserted then
+ */
+bool Table::insertRows(Row *rows, size_t count) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	for (size_t i = 0; i < count; ++i) {
+		if (!insertRowLocked(&rows[i])) {
+			while (i-- > 0) {
+				deleteRowLocked(rows[i].id);
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Table::insertRowLocked(Row *row) {
+	releaseFreedPages();
+	{
+		Cursor c = tableFindHinted(row->id);
+
+		if (c.cellNum < *leaf_node_num_cells(c.node) && c.key() == row->id) {
+			releaseWriteLatches();
+			return false;
+		}
+
+		//numbered before the leaf changes, so no snapshot can miss it
+		currentWrite = versions.beginWrite(row->id);
+		leafNodeInsert(&c, row->id, row);
+	}
+	releaseWriteLatches();
+	indexRow(row);
+	versions.endWrite();
+	return true;
+}
+
+/**
+ * @brief add the entries of a new row to every index
+ */
+void Table::indexRow(Row *row) {
+	std::string_view columns[NUM_INDEX_COLUMNS] = {
+		std::string_view(row->username, strnlen(row->username, Row::USERNAME_SIZE)),
+		std::string_view(row->email, strnlen(row->email, Row::EMAIL_SIZE))
+	};
+	for (uint32_t i = 0; i < NUM_INDEX_COLUMNS; ++i) {
+		Index *index = indexes[i];
+		if (index) {
+			index->insert(columns[i], row->id);
+		}
+	}
+}
+
+/**
+ * @brief change the entries of a row in every index whose column changed
+ * @param before record of the row before the change
+ * @param after the row after it, nullptr if it was deleted
+ */
+void Table::reindexRow(const char *before, Row *after) {
+	RecordView old = view_record(before);
+	for (uint32_t i = 0; i < NUM_INDEX_COLUMNS; ++i) {
+		Index *index = indexes[i];
+		if (!index)
+			continue;
+		std::string_view oldValue = record_column(old, (IndexColumn)i);
+		if (after == nullptr) {
+			index->remove(oldValue, old.id);
+			continue;
+		}
+		const char *column = i == (uint32_t)IndexColumn::Username ? after->username : after->email;
+		std::string_view newValue(column, strnlen(column, INDEX_COLUMN_SIZE[i]));
+		if (newValue != oldValue) {
+			index->remove(oldValue, old.id);
+			index->insert(newValue, old.id);
+		}
+	}
+}
+
+/**
+ * @brief take the row with id key out of the table and the indexes
+ * @return false if there is no such row
+ */
+bool Table::deleteRow(uint32_t key) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	return deleteRowLocked(key);
+}
+
+bool Table::deleteRowLocked(uint32_t key) {
+	releaseFreedPages();
+	char record[Row::RECORD_MAX_SIZE];
+	{
+		Cursor c = descendExclusive(key, node_is_safe_for_delete);
+
+		if (c.cellNum >= *leaf_node_num_cells(c.node) || c.key() != key) {
+			releaseWriteLatches();
+			return false;
+		}
+
+		uint32_t size = view_record(c.value()).size;
+		memcpy(record, c.value(), size);
+		//numbered before the leaf changes, with the record snapshots keep seeing
+		currentWrite = versions.beginWrite(key, record, size);
+		leaf_node_remove_cell(c.node, c.cellNum, size);
+		pager->markDirty(c.pageNum);
+		if (leafNodeRebalance(&c, key)) {
+			//merges above move leaves to other parents, see setParent()
+			c.release();
+			internalNodeRebalance(key);
+		}
+	}
+	releaseWriteLatches();
+	reindexRow(record, nullptr);
+	versions.endWrite();
+	return true;
+}
+
+/**
+ * @brief overwrite the columns of row key that aren't nullptr
+ * @details A record that still fits its leaf is replaced in place,
+ * otherwise it is taken out and inserted again, in one write, so
+ * snapshots never miss the row in between.
+ * @return false if there is no such row
+ */
+bool Table::updateRow(uint32_t key, const char *username, const char *email) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	releaseFreedPages();
+	char before[Row::RECORD_MAX_SIZE];
+	Row row;
+	bool fits;
+	{
+		Cursor c = descendExclusive(key, node_is_safe_for_delete);
+
+		if (c.cellNum >= *leaf_node_num_cells(c.node) || c.key() != key) {
+			releaseWriteLatches();
+			return false;
+		}
+
+		uint32_t beforeSize = view_record(c.value()).size;
+		memcpy(before, c.value(), beforeSize);
+		row.decode(before);
+		if (username) {
+			strncpy(row.username, username, Row::USERNAME_SIZE);
+		}
+		if (email) {
+			strncpy(row.email, email, Row::EMAIL_SIZE);
+		}
+		char record[Row::RECORD_MAX_SIZE];
+		uint32_t size = row.encode(record);
+
+		currentWrite = versions.beginWrite(key, before, beforeSize);
+		leaf_node_remove_cell(c.node, c.cellNum, beforeSize);
+		fits = leaf_node_insert_cell(c.node, c.cellNum, record, size);
+		pager->markDirty(c.pageNum);
+		//a record that grew out of a full leaf leaves it full enough, it never needs a merge
+		if (fits && leafNodeRebalance(&c, key)) {
+			c.release();
+			internalNodeRebalance(key);
+		}
+	}
+	releaseWriteLatches();
+
+	if (!fits) {
+		Cursor c = tableFindHinted(key);
+		leafNodeInsert(&c, key, &row);
+		releaseWriteLatches();
+	}
+	reindexRow(before, &row);
+	versions.endWrite();
+	return true;
+}
+
+static void leaf_node_append_cells(char *node, char *from) {
+	uint32_t numCells = *leaf_node_num_cells(from);
+	for (uint32_t i = 0; i < numCells; ++i) {
+		char *cell = leaf_node_cell(from, i);
+		leaf_node_insert_cell(node, *leaf_node_num_cells(node), cell, view_record(cell).size);
+	}
+}
+
+/**
+ * @brief after a delete left the leaf of c underfull, merge it with a
+ * sibling, or move cells over to it from its left sibling
+ * @details Siblings are latched left to right, the way scans walk the
+ * leaf chain. Cells only move right when they are redistributed, merges
+ * move them left and empty the page on the right, see Cursor. The
+ * cursor stays on its leaf, latched.
+ * @returns true if the parent lost a child
+ */
+bool Table::leafNodeRebalance(Cursor *c, uint32_t key) {
+	char *node = c->node;
+	if (is_node_root(node) || leaf_node_used_space(node) >= LEAF_NODE_MIN_USED)
+		return false;
+
+	//the leaf wasn't safe, so the descent kept its parent latched
+	uint32_t parentPageNum = writeLatches.back();
+	char *parent = pager->getPage(parentPageNum);
+	uint32_t numKeys = *internal_node_num_keys(parent);
+	uint32_t index = internal_node_find_child(parent, key);
+	leafHint.valid = false;
+
+	if (index < numKeys) {
+		uint32_t rightPageNum = *internal_node_child(parent, index + 1);
+		char *right = pager->latchPage(rightPageNum, Latch::Exclusive);
+		if (leaf_node_used_space(node) + leaf_node_used_space(right) <= LEAF_NODE_MERGE_MAX_USED) {
+			leaf_node_append_cells(node, right);
+			*leaf_node_next_leaf(node) = *leaf_node_next_leaf(right);
+			pager->markDirty(c->pageNum);
+			pager->unlatchPage(rightPageNum, Latch::Exclusive);
+			internalNodeRemove(parentPageNum, index + 1);
+			freePageLater(rightPageNum);
+			stat_add(stats.leafMerges);
+			return true;
+		}
+		pager->unlatchPage(rightPageNum, Latch::Exclusive);
+	}
+	if (index == 0)
+		return false;
+
+	uint32_t leftPageNum = *internal_node_child(parent, index - 1);
+	pager->unlatchPage(c->pageNum, Latch::Exclusive);
+	char *left = pager->latchPage(leftPageNum, Latch::Exclusive);
+	node = pager->latchPage(c->pageNum, Latch::Exclusive);
+	c->node = node;
+
+	if (leaf_node_used_space(left) + leaf_node_used_space(node) <= LEAF_NODE_MERGE_MAX_USED) {
+		leaf_node_append_cells(left, node);
+		*leaf_node_next_leaf(left) = *leaf_node_next_leaf(node);
+		pager->markDirty(leftPageNum);
+		pager->unlatchPage(leftPageNum, Latch::Exclusive);
+		internalNodeRemove(parentPageNum, index);
+		freePageLater(c->pageNum);
+		stat_add(stats.leafMerges);
+		return true;
+	}
+
+	//the left sibling holds plenty, its last cells move over until both hold about the same
+	while (true) {
+		uint32_t last = *leaf_node_num_cells(left) - 1;
+		char *cell = leaf_node_cell(left, last);
+		uint32_t size = view_record(cell).size;
+		if (leaf_node_used_space(node) + size + LEAF_NODE_SLOT_SIZE > leaf_node_used_space(left))
+			break;
+		leaf_node_insert_cell(node, 0, cell, size);
+		leaf_node_remove_cell(left, last, size);
+	}
+	*internal_node_key(parent, index - 1) = leaf_node_key(left, *leaf_node_num_cells(left) - 1);
+	pager->markDirty(parentPageNum);
+	pager->markDirty(leftPageNum);
+	pager->markDirty(c->pageNum);
+	pager->unlatchPage(leftPageNum, Latch::Exclusive);
+	return false;
+}
+
+/**
+ * @brief walk the writer's path up from the parent of the leaf, merging
+ * the nodes a merge below left underfull, and let the tree shrink by a
+ * level when the root is left with a single child
+ */
+void Table::internalNodeRebalance(uint32_t key) {
+	for (size_t level = writeLatches.size(); level-- > 0;) {
+		uint32_t pageNum = writeLatches[level];
+		char *node = pager->getPage(pageNum);
+		if (is_node_root(node)) {
+			if (*internal_node_num_keys(node) == 0) {
+				collapseRoot();
+			}
+			return;
+		}
+		//a node kept without its parent was safe and can't be underfull
+		if (level == 0 || *internal_node_num_keys(node) >= INTERNAL_NODE_MIN_KEYS)
+			return;
+		if (!internalNodeMerge(writeLatches[level - 1], pageNum, key))
+			return;
+	}
+}
+
+/**
+ * @brief merge the internal node pageNum with its right or else its left
+ * sibling, the separator between the two comes down from the parent
+ * @returns false if neither sibling has room
+ */
+bool Table::internalNodeMerge(uint32_t parentPageNum, uint32_t pageNum, uint32_t key) {
+	char *parent = pager->getPage(parentPageNum);
+	uint32_t numKeys = *internal_node_num_keys(parent);
+	uint32_t index = internal_node_find_child(parent, key);
+	uint32_t nodeKeys = *internal_node_num_keys(pager->getPage(pageNum));
+
+	//index - 1 wraps around for the first child and is skipped
+	for (uint32_t siblingIndex : {index + 1, index - 1}) {
+		if (siblingIndex > numKeys)
+			continue;
+		uint32_t siblingPageNum = *internal_node_child(parent, siblingIndex);
+		char *sibling = pager->latchPage(siblingPageNum, Latch::Exclusive);
+		if (*internal_node_num_keys(sibling) + nodeKeys + 1 > INTERNAL_NODE_MAX_KEYS) {
+			pager->unlatchPage(siblingPageNum, Latch::Exclusive);
+			continue;
+		}
+
+		uint32_t leftIndex = std::min(index, siblingIndex);
+		uint32_t leftPageNum = *internal_node_child(parent, leftIndex);
+		uint32_t rightPageNum = *internal_node_child(parent, leftIndex + 1);
+		char *left = pager->getPage(leftPageNum);
+		char *right = pager->getPage(rightPageNum);
+		uint32_t leftKeys = *internal_node_num_keys(left);
+		uint32_t rightKeys = *internal_node_num_keys(right);
+
+		//the right child of the left node gets the separator as its bound
+		uint32_t leftRightChild = *internal_node_right_child(left);
+		*internal_node_num_keys(left) = leftKeys + 1 + rightKeys;
+		*internal_node_child(left, leftKeys) = leftRightChild;
+		*internal_node_key(left, leftKeys) = *internal_node_key(parent, leftIndex);
+		memcpy(internal_node_cell(left, leftKeys + 1), internal_node_cell(right, 0),
+		       rightKeys * INTERNAL_NODE_CELL_SIZE);
+		*internal_node_right_child(left) = *internal_node_right_child(right);
+		pager->markDirty(leftPageNum);
+
+		for (uint32_t i = leftKeys + 1; i <= leftKeys + 1 + rightKeys; ++i) {
+			setParent(*internal_node_child(left, i), leftPageNum);
+		}
+		pager->unlatchPage(siblingPageNum, Latch::Exclusive);
+		internalNodeRemove(parentPageNum, leftIndex + 1);
+		freePageLater(rightPageNum);
+		stat_add(stats.internalMerges);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief take child index out of the node, its keys were merged into
+ * child index - 1, which takes over its bound
+ */
+void Table::internalNodeRemove(uint32_t pageNum, uint32_t index) {
+	char *node = pager->getPage(pageNum);
+	uint32_t numKeys = *internal_node_num_keys(node);
+	uint32_t removed = index;
+	if (index == numKeys) {
+		*internal_node_right_child(node) = *internal_node_child(node, index - 1);
+		removed = index - 1;
 	} else {
-		std::cout << "Searching internal nodes not implemented yet.\n";
-		exit(EXIT_FAILURE);
+		*internal_node_key(node, index - 1) = *internal_node_key(node, index);
 	}
+	memmove(internal_node_cell(node, removed), internal_node_cell(node, removed + 1),
+	        (numKeys - removed - 1) * INTERNAL_NODE_CELL_SIZE);
+	*internal_node_num_keys(node) = numKeys - 1;
+	pager->markDirty(pageNum);
 }
 
-void Table::createNewRoot(uint32_t rightChildPageNum) {
+/**
+ * @brief the root is left with a single child, move the child into the
+ * root page, the tree gets a level shorter
+ */
+void Table::collapseRoot() {
 	char *root = pager->getPage(rootPageNum);
-	char *rightChild = pager->getPage(rightChildPageNum);
+	uint32_t childPageNum = *internal_node_right_child(root);
+	char *child = pager->pinPage(childPageNum);
+	memcpy(root, child, PAGE_SIZE);
+	set_node_root(root, true);
+	*node_parent(root) = 0;
+	pager->markDirty(rootPageNum);
+	pager->unpinPage(childPageNum);
+
+	if (get_node_type(root) == NodeType::NodeInternal) {
+		uint32_t numKeys = *internal_node_num_keys(root);
+		for (uint32_t i = 0; i <= numKeys; ++i) {
+			setParent(*internal_node_child(root, i), rootPageNum);
+		}
+	}
+	freePageLater(childPageNum);
+	leafHint.valid = false;
+}
+
+void Table::freePageLater(uint32_t pageNum) {
+	pendingFree.push_back({currentWrite, pageNum});
+}
+
+/**
+ * @brief move the pages merges gave up to the free list once no open
+ * snapshot is older than the merge
+ * @details Older snapshots may have a copy of a leaf that still links
+ * to the page. Pages not released when the process stops are lost to
+ * the free list until the next vacuum. Call with writerMutex held.
+ */
+void Table::releaseFreedPages() {
+	if (pendingFree.empty())
+		return;
+	uint64_t oldest = versions.oldestSnapshot();
+	size_t released = 0;
+	while (released < pendingFree.size() && pendingFree[released].first <= oldest) {
+		pager->freePage(pendingFree[released].second);
+		released++;
+	}
+	pendingFree.erase(pendingFree.begin(), pendingFree.begin() + released);
+}
+
+/**
+ * @brief build an index on column from the rows already in the table
+ */
+bool Table::createIndex(IndexColumn column) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	uint32_t i = (uint32_t)column;
+	if (indexes[i])
+		return false;
+
+	uint32_t indexRoot = Index::create(pager);
+	Index *index = new Index(pager, indexRoot);
+	fillIndex(index, column);
+	//readers only find the index once it holds every row
+	indexes[i] = index;
+	*meta_index_root(pager->pinPage(META_PAGE_NUM), i) = indexRoot;
+	pager->markDirty(META_PAGE_NUM);
+	pager->unpinPage(META_PAGE_NUM);
+
+	autocommitLocked();
+	return true;
+}
+
+/**
+ * @brief add every row of the table to index
+ */
+void Table::fillIndex(Index *index, IndexColumn column) {
+	//the cursor latches its leaf, so the value stays put while the index grows
+	Cursor c = tableStart();
+	while (!c.endOfTable) {
+		RecordView record = view_record(c.value());
+		index->insert(record_column(record, column), record.id);
+		c.advance();
+	}
+}
+
+/**
+ * @brief ids of the rows whose column equals value, in id order
+ */
+void Table::indexLookup(IndexColumn column, std::string_view value, std::vector<uint32_t> &ids) {
+	indexes[(uint32_t)column].load()->find(value, ids);
+}
+
+/**
+ * @brief point the node at pageNum to its parent
+ * @details Only the writer reads parent pointers, but the flusher and
+ * readers latch the whole page, so the store takes the exclusive latch
+ * unless the writer holds it already. No leaf may be latched by the
+ * caller: a scan holding the leaf before it would wait for it.
+ */
+void Table::setParent(uint32_t pageNum, uint32_t parentPageNum) {
+	bool latched = std::find(writeLatches.begin(), writeLatches.end(), pageNum) != writeLatches.end();
+	char *node = latched ? pager->getPage(pageNum) : pager->latchPage(pageNum, Latch::Exclusive);
+	*node_parent(node) = parentPageNum;
+	pager->markDirty(pageNum);
+	if (!latched) {
+		pager->unlatchPage(pageNum, Latch::Exclusive);
+	}
+}
+
+/**
+ * @brief split the root in two levels
+ * @details The root always stays at rootPageNum. Its content moves to a
+ * new left child, the root becomes an internal node over that left child
+ * and rightChildPageNum, separated by leftMaxKey.
+ */
+void Table::createNewRoot(uint32_t rightChildPageNum, uint32_t leftMaxKey) {
+	char *root = pager->pinPage(rootPageNum);
 	uint32_t leftChildPageNum = pager->getUnusedPageNum();
-	char *leftChild = pager->getPage(leftChildPageNum);
+	char *leftChild = pager->pinPage(leftChildPageNum);
 
 	memcpy(leftChild, root, PAGE_SIZE);
 	set_node_root(leftChild, false);
+	*node_parent(leftChild) = rootPageNum;
 
 	initialize_internal_node(root);
 	set_node_root(root, true);
 	*internal_node_num_keys(root) = 1;
 	*internal_node_child(root, 0) = leftChildPageNum;
-	uint32_t leftChildMaxKey = get_node_max_key(leftChild);
-	*internal_node_key(root, 0) = leftChildMaxKey;
+	*internal_node_key(root, 0) = leftMaxKey;
 	*internal_node_right_child(root) = rightChildPageNum;
 
+	pager->markDirty(rootPageNum);
+	pager->markDirty(leftChildPageNum);
+
+	//children of the old root now hang off the left child
+	if (get_node_type(leftChild) == NodeType::NodeInternal) {
+		uint32_t numKeys = *internal_node_num_keys(leftChild);
+		for (uint32_t i = 0; i <= numKeys; ++i) {
+			setParent(*internal_node_child(leftChild, i), leftChildPageNum);
+		}
+	}
+
+	pager->unpinPage(leftChildPageNum);
+	pager->unpinPage(rootPageNum);
+	setParent(rightChildPageNum, rootPageNum);
 }
 
-void Table::leafNodeInsert(Cursor *c, uint32_t key, Row *value) {
-	char *node = pager->getPage(c->pageNum);
-	uint32_t numCells = *leaf_node_num_cells(node);
-	//the node is full
-	if (numCells >= LEAF_NODE_MAX_CELLS) {
-		//split and insert
-		leafNodeSplitAndInsert(c, key, value);
+/**
+ * @brief record in the parent that a child split in two
+ * @details leftChildPageNum keeps its slot, now bounded by leftMaxKey,
+ * and rightChildPageNum is inserted after it, taking over the old bound.
+ */
+void Table::internalNodeInsert(uint32_t parentPageNum, uint32_t leftChildPageNum,
+                               uint32_t leftMaxKey, uint32_t rightChildPageNum) {
+	char *parent = pager->pinPage(parentPageNum);
+	uint32_t numKeys = *internal_node_num_keys(parent);
+	uint32_t index = internal_node_find_child(parent, leftMaxKey);
+
+	if (numKeys >= INTERNAL_NODE_MAX_KEYS) {
+		pager->unpinPage(parentPageNum);
+		internalNodeSplitAndInsert(parentPageNum, index, leftMaxKey, rightChildPageNum);
 		return;
 	}
 
-	if (c->cellNum < numCells) {
-		for (uint32_t i = 0; i > c->cellNum; --i) {
-			memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1), LEAF_NODE_CELL_SIZE);
-		}
+	for (uint32_t i = numKeys; i > index; --i) {
+		memcpy(internal_node_cell(parent, i), internal_node_cell(parent, i - 1), INTERNAL_NODE_CELL_SIZE);
+	}
+	*internal_node_num_keys(parent) = numKeys + 1;
+	*internal_node_child(parent, index) = leftChildPageNum;
+	*internal_node_key(parent, index) = leftMaxKey;
+	if (index == numKeys) {
+		*internal_node_right_child(parent) = rightChildPageNum;
+	} else {
+		*internal_node_child(parent, index + 1) = rightChildPageNum;
 	}
 
-	*(leaf_node_num_cells(node)) += 1;
-	*(leaf_node_key(node, c->cellNum)) = key;
-	value->serialize(leaf_node_value(node, c->cellNum));
+	pager->markDirty(parentPageNum);
+	pager->unpinPage(parentPageNum);
+	setParent(rightChildPageNum, parentPageNum);
+}
+
+static void fill_internal_node(char *node, const uint32_t *keys,
+                               const uint32_t *children, uint32_t numKeys) {
+	*internal_node_num_keys(node) = numKeys;
+	for (uint32_t i = 0; i < numKeys; ++i) {
+		*internal_node_child(node, i) = children[i];
+		*internal_node_key(node, i) = keys[i];
+	}
+	*internal_node_right_child(node) = children[numKeys];
+}
+
+/**
+ * @brief split a full internal node into two and insert
+ * @details The node's keys and children plus the new pair are split in
+ * half. The left half stays on the page, the right half moves to a new
+ * page, and the middle key becomes the bound of the left half in the
+ * parent, which may split in turn.
+ */
+void Table::internalNodeSplitAndInsert(uint32_t pageNum, uint32_t index, uint32_t leftMaxKey,
+                                       uint32_t rightChildPageNum) {
+	stat_add(stats.internalSplits);
+	char *node = pager->pinPage(pageNum);
+	uint32_t numKeys = *internal_node_num_keys(node);
+
+	std::vector<uint32_t> keys;
+	std::vector<uint32_t> children;
+	keys.reserve(numKeys + 1);
+	children.reserve(numKeys + 2);
+	for (uint32_t i = 0; i < numKeys; ++i) {
+		keys.push_back(*internal_node_key(node, i));
+		children.push_back(*internal_node_child(node, i));
+	}
+	children.push_back(*internal_node_right_child(node));
+	keys.insert(keys.begin() + index, leftMaxKey);
+	children.insert(children.begin() + index + 1, rightChildPageNum);
+
+	uint32_t totalKeys = keys.size();
+	uint32_t leftNumKeys = totalKeys / 2;
+	uint32_t rightNumKeys = totalKeys - leftNumKeys - 1;
+	uint32_t separator = keys[leftNumKeys];
+
+	uint32_t newPageNum = pager->getUnusedPageNum();
+	char *newNode = pager->pinPage(newPageNum);
+	initialize_internal_node(newNode);
+	*node_parent(newNode) = *node_parent(node);
+	fill_internal_node(newNode, keys.data() + leftNumKeys + 1,
+	                   children.data() + leftNumKeys + 1, rightNumKeys);
+	fill_internal_node(node, keys.data(), children.data(), leftNumKeys);
+
+	bool splittingRoot = is_node_root(node);
+	uint32_t parentPageNum = *node_parent(node);
+	pager->markDirty(pageNum);
+	pager->markDirty(newPageNum);
+	pager->unpinPage(newPageNum);
+	pager->unpinPage(pageNum);
+
+	for (uint32_t i = leftNumKeys + 1; i < children.size(); ++i) {
+		setParent(children[i], newPageNum);
+	}
+	if (index + 1 <= leftNumKeys) {
+		setParent(rightChildPageNum, pageNum);
+	}
+
+	if (splittingRoot) {
+		createNewRoot(newPageNum, separator);
+	} else {
+		internalNodeInsert(parentPageNum, pageNum, separator, newPageNum);
+	}
+}
+
+void Table::leafNodeInsert(Cursor *c, uint32_t key, Row *value) {
+	char *node = pager->getPage(c->pageNum);
+	char record[Row::RECORD_MAX_SIZE];
+	uint32_t size = value->encode(record);
+
+	if (!leaf_node_insert_cell(node, c->cellNum, record, size)) {
+		//the node is full, split and insert
+		leafNodeSplitAndInsert(c, key, value);
+		return;
+	}
+	pager->markDirty(c->pageNum);
 }
 
 /**
  * @brief split a leaf node into two and insert
  * @details If there is no space on the leaf node, we would split the existing
- * entries residing there and the new one (being inserted) into two equal halves:
- * lower and upper halves. (Keys on the upper half are strictly greater than those
- * on the lower half.) We allocate a new leaf node, and move the upper half into the
- * new node.
+ * entries residing there and the new one (being inserted) into two halves of
+ * about the same number of bytes: lower and upper halves. (Keys on the upper half
+ * are strictly greater than those on the lower half.) We allocate a new leaf node,
+ * and move the upper half into the new node.
  */
-void Table::leafNodeSplitAndInsert(Cursor *c, uint32_t key, Row *value) {
+void Table::leafNodeSplitAndInsert(Cursor *c, uint32_t, Row *value) {
+	stat_add(stats.leafSplits);
   	/*
   	Create a new node and move half the cells over.
   	Insert the new value in one of the two nodes.
   	Update parent or create a new parent.
  	*/
- 	char *oldNode = pager->getPage(c->pageNum);
+ 	leafHint.valid = false;
+ 	char *oldNode = pager->pinPage(c->pageNum);
 	uint32_t newPageNum = pager->getUnusedPageNum();
-	char *newNode = pager->getPage(newPageNum);
+	char *newNode = pager->pinPage(newPageNum);
 	initialize_leaf_node(newNode);
+	*node_parent(newNode) = *node_parent(oldNode);
+	//the new leaf goes right after the old one in the leaf chain
+	*leaf_node_next_leaf(newNode) = *leaf_node_next_leaf(oldNode);
+	*leaf_node_next_leaf(oldNode) = newPageNum;
   	/*
-  	All existing keys plus new key should be divided
-  	evenly between old (left) and new (right) nodes.
-  	Starting from the right, move each key to correct position.
+  	All existing records plus the new one, in key order, from a copy
+  	of the old node, which is then rebuilt with the lower half.
   	*/
-  	for (int32_t i = LEAF_NODE_MAX_CELLS; i >= 0; --i) {
-		  char *destNode;
-		  if (i >= LEAF_NODE_LEFT_SPLIT_COUNT) {
-			  destNode = newNode;
-		} else {
-			destNode = oldNode;
-		}
-		uint32_t indexWithinNode = i % LEAF_NODE_LEFT_SPLIT_COUNT;
-		char *dest = leaf_node_cell(destNode, indexWithinNode);
+	char copy[PAGE_SIZE];
+	memcpy(copy, oldNode, PAGE_SIZE);
+	char record[Row::RECORD_MAX_SIZE];
+	uint32_t recordSize = value->encode(record);
 
+	uint32_t numCells = *leaf_node_num_cells(copy);
+	std::vector<std::pair<const char *, uint32_t>> cells;
+	cells.reserve(numCells + 1);
+	uint32_t totalBytes = 0;
+	for (uint32_t i = 0; i <= numCells; ++i) {
 		if (i == c->cellNum) {
-			value->serialize(dest);
-		} else if (i > c->cellNum) {
-			memcpy(dest, leaf_node_cell(oldNode, i - 1), LEAF_NODE_CELL_SIZE);
-		} else {
-			memcpy(dest, leaf_node_cell(oldNode, i), LEAF_NODE_CELL_SIZE);
+			cells.push_back({record, recordSize});
 		}
+		if (i < numCells) {
+			const char *cell = leaf_node_cell(copy, i);
+			cells.push_back({cell, view_record(cell).size});
+		}
+	}
+	for (auto &cell : cells) {
+		totalBytes += cell.second + LEAF_NODE_SLOT_SIZE;
+	}
+
+	//the left half takes cells until it holds half of the bytes
+	uint32_t leftCount = 0;
+	uint32_t leftBytes = 0;
+	while (leftCount + 1 < cells.size() && leftBytes < totalBytes / 2) {
+		leftBytes += cells[leftCount].second + LEAF_NODE_SLOT_SIZE;
+		leftCount++;
+	}
+
+	uint32_t nextLeaf = *leaf_node_next_leaf(oldNode);
+	bool isRoot = is_node_root(oldNode);
+	initialize_leaf_node(oldNode);
+	set_node_root(oldNode, isRoot);
+	*node_parent(oldNode) = *node_parent(copy);
+	*leaf_node_next_leaf(oldNode) = nextLeaf;
+	for (uint32_t i = 0; i < cells.size(); ++i) {
+		char *destNode = i < leftCount ? oldNode : newNode;
+		leaf_node_insert_cell(destNode, *leaf_node_num_cells(destNode), cells[i].first, cells[i].second);
 	}
 
-	//update cell count on both leaf nodes
-	*(leaf_node_num_cells(oldNode)) = LEAF_NODE_LEFT_SPLIT_COUNT;
-	*(leaf_node_num_cells(newNode)) = LEAF_NODE_RIGHT_SPLIT_COUNT;
+	pager->markDirty(c->pageNum);
+	pager->markDirty(newPageNum);
+	bool oldNodeIsRoot = is_node_root(oldNode);
+	uint32_t parentPageNum = *node_parent(oldNode);
+	uint32_t oldNodeMaxKey = get_node_max_key(oldNode);
+	pager->unpinPage(newPageNum);
+	pager->unpinPage(c->pageNum);
 
-	if (is_node_root(oldNode)) {
-		return createNewRoot(newPageNum);
+	if (oldNodeIsRoot) {
+		createNewRoot(newPageNum, oldNodeMaxKey);
 	} else {
-		std::cout << "Need to implement updating parent after splitting\n";
-		exit(EXIT_FAILURE);
+		//both leaves are complete, the parent stays latched; scans
+		//waiting for the leaf must not hold up setParent() on theirs
+		uint32_t oldPageNum = c->pageNum;
+		c->release();
+		internalNodeInsert(parentPageNum, oldPageNum, oldNodeMaxKey, newPageNum);
 	}
 }
 
-Cursor* Table::leafNodeFind(uint32_t pageNum, uint32_t key) {
-	char *node = pager->getPage(pageNum);
-	uint32_t numOfCells = *leaf_node_num_cells(node);
+Cursor Table::leafNodeFind(uint32_t pageNum, char *node, uint32_t key, Latch mode) {
+	Cursor c(this, pageNum, node, mode);
+	c.cellNum = leaf_node_find_cell(node, key);
+	return c;
+}
 
-	Cursor *c = new Cursor;
-	c->table = this;
-	c->pageNum = pageNum;
+/*
+ * Builds a tree bottom-up from sorted rows. Every level has at most
+ * one open node, filled left to right; a full node is closed and handed
+ * to the level above. Page numbers are handed out in creation order, so
+ * the file is written front to back.
+ *
+ * A node gets its parent page when it is created: before the second
+ * node of a level starts, the level above gets its open node, and
+ * before a node starts under a full parent, that parent is closed and
+ * replaced. Only the first node of each level learns its parent later.
+ */
+class BulkLoader {
+	struct Level {
+		//page of the open node, INVALID_PAGE_NUM if none
+		uint32_t pageNum;
+		uint32_t parentPageNum;
+		//(page, max key) of the closed children of the open node
+		std::vector<std::pair<uint32_t, uint32_t>> children;
+	};
 
-	//Binary search
-	uint32_t minIndex = 0;
-	uint32_t onePastMaxIndex = numOfCells;
-	while (onePastMaxIndex != minIndex) {
-		uint32_t index = (onePastMaxIndex + minIndex) / 2;
-		uint32_t keyAtIndex = *(leaf_node_key(node, index));
-		if (key == keyAtIndex) {
-			c->cellNum = index;
-			return c;
+	Table *table;
+	Pager *pager;
+	//bytes of cells and slots a leaf is filled to
+	uint32_t leafBytes;
+	uint32_t internalChildren;
+	//levels[0] are the leaves
+	std::vector<Level> levels;
+	char *leaf;
+	//every page handed out for the load, in order
+	std::vector<uint32_t> pages;
+
+	uint32_t startNode(uint32_t level);
+	void closeNode(uint32_t level, uint32_t maxKey);
+
+public:
+	BulkLoader(Table *table, double fillFactor);
+
+	void add(Row &row);
+	void finish();
+	void abort();
+};
+
+BulkLoader::BulkLoader(Table *table, double fillFactor)
+    : table(table), pager(table->getPager()), leaf(nullptr) {
+    if (fillFactor <= 0 || fillFactor > 1) {
+        fillFactor = 1;
+    }
+    leafBytes = LEAF_NODE_SPACE_FOR_CELLS * fillFactor;
+    internalChildren = std::max<uint32_t>(2, (INTERNAL_NODE_MAX_KEYS + 1) * fillFactor);
+    levels.push_back(Level{INVALID_PAGE_NUM, INVALID_PAGE_NUM, {}});
+}
+
+/**
+ * @brief open a new node on level, after its parent is sorted out
+ */
+uint32_t BulkLoader::startNode(uint32_t level) {
+	uint32_t parentPageNum = INVALID_PAGE_NUM;
+	if (levels.size() > level + 1) {
+		if (levels[level + 1].pageNum == INVALID_PAGE_NUM) {
+			//second node of this level, the first one gets its parent now
+			startNode(level + 1);
+			table->setParent(levels[level + 1].children[0].first, levels[level + 1].pageNum);
+		} else if (levels[level + 1].children.size() >= internalChildren) {
+			closeNode(level + 1, levels[level + 1].children.back().second);
+			startNode(level + 1);
 		}
-		if (key < keyAtIndex) {
-			onePastMaxIndex = index;
-		} else {
-			minIndex = index + 1;
+		parentPageNum = levels[level + 1].pageNum;
+	}
+
+	uint32_t pageNum = pager->getUnusedPageNum();
+	pager->getPage(pageNum);
+	pages.push_back(pageNum);
+	levels[level].pageNum = pageNum;
+	levels[level].parentPageNum = parentPageNum;
+	return pageNum;
+}
+
+/**
+ * @brief write out the open node of level and hand it to the level above
+ */
+void BulkLoader::closeNode(uint32_t level, uint32_t maxKey) {
+	Level &l = levels[level];
+	if (level > 0) {
+		char *node = pager->pinPage(l.pageNum);
+		initialize_internal_node(node);
+		*node_parent(node) = l.parentPageNum;
+		*internal_node_num_keys(node) = l.children.size() - 1;
+		for (uint32_t i = 0; i + 1 < l.children.size(); ++i) {
+			*internal_node_child(node, i) = l.children[i].first;
+			*internal_node_key(node, i) = l.children[i].second;
 		}
+		*internal_node_right_child(node) = l.children.back().first;
+		pager->markDirty(l.pageNum);
+		pager->unpinPage(l.pageNum);
+		l.children.clear();
 	}
 
-	c->cellNum = minIndex;
-	return c;
+	uint32_t pageNum = l.pageNum;
+	l.pageNum = INVALID_PAGE_NUM;
+	if (levels.size() == level + 1) {
+		levels.push_back(Level{INVALID_PAGE_NUM, INVALID_PAGE_NUM, {}});
+	}
+	levels[level + 1].children.push_back({pageNum, maxKey});
 }
 
+void BulkLoader::add(Row &row) {
+	char record[Row::RECORD_MAX_SIZE];
+	uint32_t size = row.encode(record);
+
+	if (leaf && LEAF_NODE_SPACE_FOR_CELLS - leaf_node_free_space(leaf) + size + LEAF_NODE_SLOT_SIZE > leafBytes) {
+		uint32_t oldPageNum = levels[0].pageNum;
+		closeNode(0, leaf_node_key(leaf, *leaf_node_num_cells(leaf) - 1));
+		uint32_t newPageNum = startNode(0);
+		*leaf_node_next_leaf(leaf) = newPageNum;
+		pager->markDirty(oldPageNum);
+		pager->unpinPage(oldPageNum);
+		leaf = nullptr;
+	}
+
+	if (!leaf) {
+		if (levels[0].pageNum == INVALID_PAGE_NUM) {
+			startNode(0);
+		}
+		leaf = pager->pinPage(levels[0].pageNum);
+		initialize_leaf_node(leaf);
+		*node_parent(leaf) = levels[0].parentPageNum;
+	}
+
+	leaf_node_insert_cell(leaf, *leaf_node_num_cells(leaf), record, size);
+}
+
+/**
+ * @brief close every open node and move the top one to the root page
+ */
+void BulkLoader::finish() {
+	if (!leaf)
+		return;
+
+	uint32_t leafPageNum = levels[0].pageNum;
+	uint32_t maxKey = leaf_node_key(leaf, *leaf_node_num_cells(leaf) - 1);
+	pager->markDirty(leafPageNum);
+	pager->unpinPage(leafPageNum);
+	closeNode(0, maxKey);
+
+	uint32_t level = 1;
+	while (levels[level].pageNum != INVALID_PAGE_NUM) {
+		closeNode(level, levels[level].children.back().second);
+		level++;
+	}
+
+	//the level without an open node has a single child, the new root
+	uint32_t topPageNum = levels[level].children[0].first;
+	uint32_t rootPageNum = table->getRootPageNum();
+	char *top = pager->pinPage(topPageNum);
+	//the new tree becomes visible to readers here
+	char *root = pager->latchPage(rootPageNum, Latch::Exclusive);
+	memcpy(root, top, PAGE_SIZE);
+	set_node_root(root, true);
+	*node_parent(root) = 0;
+	pager->markDirty(rootPageNum);
+	pager->unpinPage(topPageNum);
+	//nothing links to the top node, the root holds it now
+	pager->freePage(topPageNum);
+
+	if (get_node_type(root) == NodeType::NodeInternal) {
+		uint32_t numKeys = *internal_node_num_keys(root);
+		for (uint32_t i = 0; i <= numKeys; ++i) {
+			table->setParent(*internal_node_child(root, i), rootPageNum);
+		}
+	}
+	pager->unlatchPage(rootPageNum, Latch::Exclusive);
+}
+
+/**
+ * @brief drop the load, its pages go back to the free list
+ * @details None of them is linked to the root yet, so no reader or
+ * snapshot can reach them.
+ */
+void BulkLoader::abort() {
+	if (leaf) {
+		pager->unpinPage(levels[0].pageNum);
+		leaf = nullptr;
+	}
+	for (uint32_t pageNum : pages) {
+		pager->freePage(pageNum);
+	}
+	pages.clear();
+}
+
+/**
+ * @brief load an empty table from rows sorted by id
+ * @details Leaves are packed to fillFactor of their capacity and the
+ * internal levels are built in the same pass, instead of descending
+ * and splitting once per row. On an error the table stays empty.
+ */
+BulkLoadResult Table::bulkLoad(RowSource &source, double fillFactor) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	char *rootNode = pager->getPage(rootPageNum);
+	if (get_node_type(rootNode) != NodeType::NodeLeaf || *leaf_node_num_cells(rootNode) != 0) {
+		return BulkLoadTableNotEmpty;
+	}
+
+	leafHint.valid = false;
+	BulkLoader loader(this, fillFactor);
+	Row row;
+	bool first = true;
+	uint32_t lastKey = 0;
+	while (source.next(row)) {
+		if (!first && row.id <= lastKey) {
+			//the partial tree is not linked to the root, drop it
+			loader.abort();
+			autocommitLocked();
+			return BulkLoadUnsorted;
+		}
+		loader.add(row);
+		first = false;
+		lastKey = row.id;
+	}
+	loader.finish();
+	//indexes are filled after the table, so its pages stay in one run
+	for (uint32_t i = 0; i < NUM_INDEX_COLUMNS; ++i) {
+		if (indexes[i]) {
+			fillIndex(indexes[i], (IndexColumn)i);
+		}
+	}
+	autocommitLocked();
+	return BulkLoadSuccess;
+}
+
+/**
+ * @brief start a transaction, statements until commit() share
+ * one durability point
+ */
+bool Table::begin(const void *owner) {
+	std::unique_lock<std::mutex> lock(writerMutex);
+	//writes of others already running don't become part of it
+	statementsDone.wait(lock, [this] { return transactionActive || runningStatements == 0; });
+	if (transactionActive)
+		return false;
+	transactionActive = true;
+	transactionOwner = owner;
+	return true;
+}
+
+/**
+ * @brief end the current unit of work, with the write-ahead
+ * log this is the durability point of the changes made so far
+ */
+bool Table::commit(const void *owner) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	if (!transactionActive || transactionOwner != owner)
+		return false;
+	commitLocked();
+	return true;
+}
+
+void Table::commitLocked() {
+	transactionActive = false;
+	transactionOwner = nullptr;
+	pager->commit();
+}
+
+/**
+ * @brief commit after a statement unless a transaction is open
+ */
+void Table::autocommit() {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	autocommitLocked();
+}
+
+void Table::autocommitLocked() {
+	if (!transactionActive) {
+		commitLocked();
+	}
+}
+
+bool Table::startStatement(const void *owner) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	if (transactionActive)
+		return transactionOwner == owner;
+	runningStatements += 1;
+	return true;
+}
+
+void Table::finishStatement(const void *owner) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	//no transaction begins while the statement runs, see begin()
+	if (transactionActive && transactionOwner == owner)
+		return;
+	commitLocked();
+	runningStatements -= 1;
+	if (runningStatements == 0) {
+		statementsDone.notify_all();
+	}
+}
 
 void Table::dbClose() {
-	std::cout << pager->getNumOfPages();
-	for (uint32_t i = 0; i < pager->getNumOfPages(); ++i) {
-		if (pager->getPage(i) == nullptr)
-			continue;
-		pager->_flush(i);
+	//the last dump still sees the file open
+	delete statsDumper;
+	statsDumper = nullptr;
+	closeFile();
+}
+
+void Table::closeFile() {
+	//no snapshot is open any more
+	for (auto &freed : pendingFree) {
+		pager->freePage(freed.second);
 	}
+	pendingFree.clear();
+	pager->flushAll();
 
 	int result = pager->_close();
 	if (result == -1) {
@@ -186,6 +1342,149 @@ void Table::dbClose() {
 	}
 }
 
+/*
+ * The rows of a table in id order, what vacuum() loads into the new file
+ */
+class TableRowSource : public RowSource {
+	Cursor c;
+
+public:
+	explicit TableRowSource(Table *table) : c(table->tableStart()) {
+	}
+
+	bool next(Row &row) override {
+		if (c.endOfTable)
+			return false;
+		row.decode(c.value());
+		c.advance();
+		return true;
+	}
+};
+
+/**
+ * @brief rewrite the table and its indexes into a new file, packed like
+ * a bulk load, and put it in place of the old one
+ * @details Free pages and the underfull nodes deletes leave behind don't
+ * make it into the new file. An open transaction is committed first.
+ * Nothing else may use the table meanwhile.
+ */
+void Table::vacuum() {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	commitLocked();
+
+	std::string vacuumPath = filename + "-vacuum";
+	unlink(vacuumPath.c_str());
+	unlink((vacuumPath + "-wal").c_str());
+	PagerOptions vacuumOptions = options;
+	vacuumOptions.compress = pager->isCompressed();
+	{
+		Table vacuumed;
+		vacuumed.dbOpen(vacuumPath, vacuumOptions);
+		TableRowSource rows(this);
+		vacuumed.bulkLoad(rows);
+		for (uint32_t i = 0; i < NUM_INDEX_COLUMNS; ++i) {
+			if (indexes[i]) {
+				vacuumed.createIndex((IndexColumn)i);
+			}
+		}
+		vacuumed.dbClose();
+	}
+
+	//the dumper waits for writerMutex, stopping it here would never return
+	closeFile();
+	delete pager;
+	pager = nullptr;
+	for (std::atomic<Index *> &index : indexes) {
+		delete index.load();
+		index = nullptr;
+	}
+	if (rename(vacuumPath.c_str(), filename.c_str()) == -1) {
+		std::cout << "Error replacing the database file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+	dbOpen(filename, options);
+}
+
+/**
+ * @brief descend to the first leaf for the height, and with walk visit
+ * every node for how full they are
+ * @details Holds writerMutex, so no split or merge changes the tree and
+ * vacuum() doesn't swap the file meanwhile. Readers go on.
+ */
+TreeShape Table::measureTree(bool walk) {
+	std::lock_guard<std::mutex> lock(writerMutex);
+	TreeShape shape = {0, 0, 0, 0, 0};
+	if (walk) {
+		measureNode(rootPageNum, shape);
+		return shape;
+	}
+
+	uint32_t pageNum = rootPageNum;
+	while (true) {
+		char *node = pager->latchPage(pageNum, Latch::Shared);
+		bool isLeaf = get_node_type(node) == NodeType::NodeLeaf;
+		uint32_t childPageNum = isLeaf ? 0 : *internal_node_child(node, 0);
+		pager->unlatchPage(pageNum, Latch::Shared);
+		shape.height++;
+		if (isLeaf)
+			return shape;
+		pageNum = childPageNum;
+	}
+}
+
+void Table::measureNode(uint32_t pageNum, TreeShape &shape) {
+	char *node = pager->latchPage(pageNum, Latch::Shared);
+	if (get_node_type(node) == NodeType::NodeLeaf) {
+		shape.leaves++;
+		shape.leafBytes += leaf_node_used_space(node);
+		pager->unlatchPage(pageNum, Latch::Shared);
+		shape.height = std::max(shape.height, 1u);
+		return;
+	}
+
+	uint32_t numKeys = *internal_node_num_keys(node);
+	std::vector<uint32_t> children;
+	children.reserve(numKeys + 1);
+	for (uint32_t i = 0; i < numKeys; ++i) {
+		children.push_back(*internal_node_child(node, i));
+	}
+	children.push_back(*internal_node_right_child(node));
+	pager->unlatchPage(pageNum, Latch::Shared);
+	shape.internalNodes++;
+	shape.internalKeys += numKeys;
+
+	TreeShape below = {0, 0, 0, 0, 0};
+	for (uint32_t childPageNum : children) {
+		measureNode(childPageNum, below);
+	}
+	shape.height = std::max(shape.height, below.height + 1);
+	shape.leaves += below.leaves;
+	shape.internalNodes += below.internalNodes;
+	shape.leafBytes += below.leafBytes;
+	shape.internalKeys += below.internalKeys;
+}
+
+void Table::printStats(std::ostream &out, bool walk) {
+	print_counters(out);
+	TreeShape shape = measureTree(walk);
+	out << "tree: height " << shape.height;
+	if (walk) {
+		out << ", leaves " << shape.leaves << ", internal nodes " << shape.internalNodes;
+		if (shape.leaves > 0) {
+			out << ", leaf fill " << 100.0 * shape.leafBytes / (shape.leaves * LEAF_NODE_SPACE_FOR_CELLS) << "%";
+		}
+		if (shape.internalNodes > 0) {
+			out << ", internal fill " << 100.0 * shape.internalKeys / (shape.internalNodes * INTERNAL_NODE_MAX_KEYS) << "%";
+		}
+	}
+	out << "\n";
+}
+
+void Table::startStatsDump(const std::string &path, uint32_t intervalMs) {
+	delete statsDumper;
+	statsDumper = new StatsDumper(this, path, intervalMs);
+}
+
 void indent(uint32_t level) {
 	for (uint32_t i = 0; i < level; i++) {
 		printf("  ");
@@ -193,20 +1492,20 @@ void indent(uint32_t level) {
 }
 
 void Table::print(uint32_t page, uint32_t indentationLevel) {
-	char *node = pager->getPage(page);
+	char *node = pager->pinPage(page);
 	uint32_t numOfKeys{},
 			 child{};
 	switch(get_node_type(node)) {
-		case NodeType::NodeInternal:
+		case NodeType::NodeLeaf:
 			numOfKeys = *leaf_node_num_cells(node);
 			indent(indentationLevel);
 			printf("- leaf (size %d)\n", numOfKeys);
 			for (uint32_t i = 0; i < numOfKeys; i++) {
 				indent(indentationLevel + 1);
-				printf("- %d\n", *leaf_node_key(node, i));
+				printf("- %d\n", leaf_node_key(node, i));
 			}
 		break;
-		case NodeType::NodeLeaf:
+		case NodeType::NodeInternal:
 			numOfKeys = *internal_node_num_keys(node);
 			indent(indentationLevel);
 			printf("- internal (size %d)\n", numOfKeys);
@@ -221,4 +1520,5 @@ void Table::print(uint32_t page, uint32_t indentationLevel) {
 			print(child, indentationLevel + 1);
 		break;
 	}
+	pager->unpinPage(page);
 }
\ No newline at end of file
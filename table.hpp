@@ -3,21 +3,149 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <ostream>
+
+#include "pager.hpp"
+#include "index.hpp"
+#include "node.hpp"
+#include "version_store.hpp"
+#include "stats.hpp"
 
-class Pager;
 struct Cursor;
 struct Row;
 
+//share of each node filled by bulkLoad
+static constexpr double DEFAULT_BULK_FILL_FACTOR = 0.9;
+//a leaf left with fewer bytes of cells than this by a delete is
+//merged with a sibling or takes cells over from its left sibling
+static constexpr uint32_t LEAF_NODE_MIN_USED = LEAF_NODE_SPACE_FOR_CELLS / 3;
+//two leaves are only merged if the result keeps room for inserts
+static constexpr uint32_t LEAF_NODE_MERGE_MAX_USED = LEAF_NODE_SPACE_FOR_CELLS - LEAF_NODE_MIN_USED;
+//an internal node left with fewer keys than this is merged with a sibling
+static constexpr uint32_t INTERNAL_NODE_MIN_KEYS = INTERNAL_NODE_MAX_KEYS / 3;
+//the leaves take the records of any schema whose split leaves one on each side
+static_assert(2 * (Row::RECORD_MAX_SIZE + LEAF_NODE_SLOT_SIZE) <= LEAF_NODE_SPACE_FOR_CELLS,
+              "a leaf holds at least two records of the largest size");
+
+//what Table::measureTree() finds, the node counts only if it walked the tree
+struct TreeShape {
+	uint32_t height;
+	uint64_t leaves;
+	uint64_t internalNodes;
+	//bytes of cells in all leaves, keys in all internal nodes
+	uint64_t leafBytes;
+	uint64_t internalKeys;
+};
+
+enum BulkLoadResult {
+	BulkLoadSuccess,
+	BulkLoadTableNotEmpty,
+	BulkLoadUnsorted
+};
+
+/*
+ * Input of Table::bulkLoad, rows have to come
+ * in strictly increasing id order.
+ */
+struct RowSource {
+	virtual ~RowSource() {}
+	//fill row with the next row, false once the input is exhausted
+	virtual bool next(Row &row) = 0;
+};
+
+/*
+ * Any number of threads can read the table while one thread
+ * writes it. Readers descend with latch crabbing: the child is
+ * latched shared before the latch on the parent is given back.
+ * The writer latches exclusively on its way down and lets go of
+ * the ancestors once a node can take the new entry without
+ * splitting, so a split only touches nodes it has latched.
+ * Deletes do the same with nodes that can lose an entry without
+ * getting underfull, a merge reaches its siblings by latching
+ * them after the nodes on its path.
+ * Children that move to another parent are latched one at a time
+ * to update their parent pointer, after the writer let go of its
+ * leaf, which a scan may be waiting for. New pages are only pinned
+ * while they are filled: no reader reaches them before the latched
+ * parent links them, and the flusher writes a page again if it is
+ * marked dirty after it took it.
+ * Writers take turns on writerMutex, which also covers the
+ * transaction state and the commits. A transaction belongs to
+ * whoever began it, the write statements of anybody else are
+ * refused until it commits. Selects read through a
+ * snapshot (see VersionStore), so rows written while they run
+ * don't show up halfway through. Pages a merge gives up go to
+ * the free list only once no snapshot older than the merge is
+ * open, until then scans may still follow links to them.
+ */
 class Table {
 	uint32_t numRows;
 	uint32_t rootPageNum;
 	Pager *pager;
+	bool transactionActive;
+	//who called begin(), only its statements write until it commits
+	const void *transactionOwner;
+	//write statements running outside a transaction, begin() waits for them
+	uint32_t runningStatements;
+	std::condition_variable statementsDone;
+	//nullptr for columns without an index, set once the index is filled
+	std::atomic<Index *> indexes[NUM_INDEX_COLUMNS];
+	std::mutex writerMutex;
+	//ancestors of the writer's leaf it still holds exclusively, root first
+	std::vector<uint32_t> writeLatches;
+	//which rows the open snapshots don't see yet
+	VersionStore versions;
+	//number of the write in progress
+	uint64_t currentWrite;
+	//(write, page) of the pages given up by merges, not yet on the free list
+	std::vector<std::pair<uint64_t, uint32_t>> pendingFree;
+	//what dbOpen was called with, vacuum() opens the file again
+	std::string filename;
+	PagerOptions options;
+	//appends printStats() to a file, nullptr unless startStatsDump() was called
+	StatsDumper *statsDumper;
+
+	//leaf the last insert descended to, with the keys it may hold:
+	//(low, high]. Valid until the next split or merge changes the tree.
+	struct LeafHint {
+		bool valid;
+		uint32_t pageNum;
+		int64_t low;
+		uint32_t high;
+	} leafHint;
+
+	char *findLeaf(uint32_t key, uint32_t &pageNum);
+	Cursor tableFindHinted(uint32_t key);
+	Cursor descendExclusive(uint32_t key, bool (*isSafe)(char *node));
+	void releaseWriteLatches();
+	void upgradeFile();
+	void convertLeaves();
+	void indexRow(Row *row);
+	void reindexRow(const char *before, Row *after);
+	bool leafNodeRebalance(Cursor *c, uint32_t key);
+	void internalNodeRebalance(uint32_t key);
+	bool internalNodeMerge(uint32_t parentPageNum, uint32_t pageNum, uint32_t key);
+	void internalNodeRemove(uint32_t pageNum, uint32_t index);
+	void collapseRoot();
+	void freePageLater(uint32_t pageNum);
+	void releaseFreedPages();
+	void fillIndex(Index *index, IndexColumn column);
+	bool insertRowLocked(Row *row);
+	bool deleteRowLocked(uint32_t key);
+	void commitLocked();
+	void autocommitLocked();
+	void closeFile();
+	void measureNode(uint32_t pageNum, TreeShape &shape);
 
 public:
     Table();
     ~Table();
 
-	void dbOpen(std::string filename);
+	void dbOpen(std::string filename, const PagerOptions &options = PagerOptions());
 
 	inline uint32_t getNumRows() {
 		return numRows; 
@@ -31,25 +159,104 @@ public:
 		return rootPageNum;
 	}
 
-	Cursor *tableStart();
+	Cursor tableStart();
+
+	Cursor tableSeek(uint32_t key);
 
 	//Return the position of a given key.
 	//In case the key is not found, return the
-	//position where it should be inserted
-	Cursor *tableFind(uint32_t key);
+	//position where it should be inserted.
+	//The cursor holds its leaf latched shared.
+	Cursor tableFind(uint32_t key);
+
+	//a consistent view of the table for a reader, as of the last
+	//completed insert; close it once the reader is done
+	inline uint64_t openSnapshot() {
+		return versions.openSnapshot();
+	}
+
+	inline void closeSnapshot(uint64_t snapshot) {
+		versions.closeSnapshot(snapshot);
+	}
+
+	inline void olderVersions(uint64_t snapshot, uint32_t low, uint32_t high, std::vector<RowVersion> &rows) {
+		versions.olderVersions(snapshot, low, high, rows);
+	}
+
+	//cursor over the rows snapshot sees, starting at the first key >= key,
+	//reading leaves into copy, see Cursor
+	Cursor snapshotSeek(uint32_t key, uint64_t snapshot, char *copy);
+
+	void setParent(uint32_t pageNum, uint32_t parentPageNum);
+
+	void createNewRoot(uint32_t rightChildPageNum, uint32_t leftMaxKey);
 
-	void createNewRoot(uint32_t rightChildPageNum);
+	void internalNodeInsert(uint32_t parentPageNum, uint32_t leftChildPageNum,
+	                        uint32_t leftMaxKey, uint32_t rightChildPageNum);
+
+	void internalNodeSplitAndInsert(uint32_t pageNum, uint32_t index, uint32_t leftMaxKey,
+	                                uint32_t rightChildPageNum);
+
+	bool insertRow(Row *row);
+
+	//all of count rows or none, false if an id is taken or repeats
+	bool insertRows(Row *rows, size_t count);
+
+	//false if there is no row with id key
+	bool deleteRow(uint32_t key);
+
+	//set the columns that aren't nullptr, false if there is no row with id key
+	bool updateRow(uint32_t key, const char *username, const char *email);
+
+	//false if the column already has an index
+	bool createIndex(IndexColumn column);
+
+	inline bool hasIndex(IndexColumn column) {
+		return indexes[(uint32_t)column] != nullptr;
+	}
+
+	void indexLookup(IndexColumn column, std::string_view value, std::vector<uint32_t> &ids);
 
 	void leafNodeInsert(Cursor *c, uint32_t key, Row *value);
 
 	void leafNodeSplitAndInsert(Cursor *c, uint32_t key, Row *value);
 
-	Cursor *leafNodeFind(uint32_t pageNum, uint32_t key);
+	//node is pageNum latched in mode, the cursor takes the latch over
+	Cursor leafNodeFind(uint32_t pageNum, char *node, uint32_t key, Latch mode);
+
+	BulkLoadResult bulkLoad(RowSource &source, double fillFactor = DEFAULT_BULK_FILL_FACTOR);
+
+	//false if a transaction is already active
+	bool begin(const void *owner = nullptr);
+
+	//false if owner has no transaction active
+	bool commit(const void *owner = nullptr);
+
+	void autocommit();
+
+	//around the writes of one statement of owner, false if somebody
+	//else's transaction is active, then nothing may be written
+	bool startStatement(const void *owner);
+
+	//commit unless owner's transaction is active
+	void finishStatement(const void *owner);
 
 	void dbClose();
 
+	//rewrite the file with only the pages the rows and indexes need
+	void vacuum();
+
 	void print(uint32_t page, uint32_t indentationLevel);
 
+	//height of the tree, and with walk the fill of every node
+	TreeShape measureTree(bool walk);
+
+	//the counters of stats, the statement latencies and the shape of the tree
+	void printStats(std::ostream &out, bool walk);
+
+	//append printStats() to path every intervalMs until dbClose()
+	void startStatsDump(const std::string &path, uint32_t intervalMs);
+
 	inline constexpr uint32_t rows() const {
 		return numRows;
 	}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "compressed_file.hpp"
+#include "pager.hpp"
+
+/*
+ * A compressed file that stops between two syncs, as after a crash:
+ * pages rewritten since the last sync(), in place of their image or
+ * growing out of it, still read back as they were at that sync.
+ */
+
+static constexpr uint32_t TEST_PAGES = 64;
+
+static uint32_t failures = 0;
+
+static void fail(const std::string &what) {
+	if (failures++ < 10) {
+		std::cout << what << std::endl;
+	}
+}
+
+//a page that compresses to about fill bytes of text, marked with version
+static void make_page(char *page, uint32_t pageNum, uint32_t version, uint32_t fill) {
+	memset(page, 0, PAGE_SIZE);
+	uint32_t state = pageNum * 7919 + version * 104729 + 1;
+	for (uint32_t i = 0; i < fill; ++i) {
+		state = state * 1103515245 + 12345;
+		page[i] = 'a' + (state >> 16) % 26;
+	}
+	memcpy(page + PAGE_SIZE - 2 * sizeof(uint32_t), &pageNum, sizeof(uint32_t));
+	memcpy(page + PAGE_SIZE - sizeof(uint32_t), &version, sizeof(uint32_t));
+}
+
+static void expect(CompressedFile &file, uint32_t pageNum, uint32_t version, uint32_t fill) {
+	char page[PAGE_SIZE];
+	char expected[PAGE_SIZE];
+	make_page(expected, pageNum, version, fill);
+	if (!file.readPage(pageNum, page) || memcmp(page, expected, PAGE_SIZE) != 0) {
+		fail("page " + std::to_string(pageNum) + " doesn't hold version " + std::to_string(version));
+	}
+}
+
+int main(int argc, char *argv[]) {
+	std::string path = argc > 1 ? argv[1] : "compressed_file_test.db";
+	unlink(path.c_str());
+	char page[PAGE_SIZE];
+
+	int fd = open(path.c_str(), O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+	{
+		CompressedFile file(fd);
+		file._open();
+		for (uint32_t pageNum = 0; pageNum < TEST_PAGES; ++pageNum) {
+			make_page(page, pageNum, 1, 1000);
+			file.writePage(pageNum, page);
+		}
+		file.sync();
+
+		//even pages keep their size, odd ones grow out of their units,
+		//some twice, and nothing syncs
+		for (uint32_t pageNum = 0; pageNum < TEST_PAGES; ++pageNum) {
+			make_page(page, pageNum, 2, pageNum % 2 ? 2500 : 1000);
+			file.writePage(pageNum, page);
+			if (pageNum % 4 == 1) {
+				make_page(page, pageNum, 3, 2500);
+				file.writePage(pageNum, page);
+			}
+		}
+		expect(file, 1, 3, 2500);
+		expect(file, 2, 2, 1000);
+	}
+	close(fd);
+
+	fd = open(path.c_str(), O_RDWR);
+	{
+		CompressedFile file(fd);
+		file._open();
+		for (uint32_t pageNum = 0; pageNum < TEST_PAGES; ++pageNum) {
+			expect(file, pageNum, 1, 1000);
+		}
+	}
+	close(fd);
+	unlink(path.c_str());
+
+	if (failures > 0) {
+		std::cout << failures << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "compressed_file_test passed" << std::endl;
+	return 0;
+}
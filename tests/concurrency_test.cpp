@@ -0,0 +1,168 @@
+#include <iostream>
+#include <atomic>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "table.hpp"
+#include "cursor.hpp"
+#include "node.hpp"
+#include "row.hpp"
+
+/*
+ * Readers scan and look up rows with latched cursors while one writer
+ * grows the tree by a level, shrinks it and mixes writes, in every
+ * pager mode. A row's email is made from its id and username, so
+ * readers tell a torn row from a good one without knowing the table.
+ * A latch cycle between the writer and the readers hangs the test,
+ * ctest stops it after its timeout.
+ */
+
+//enough rows of long emails for a third level of internal nodes
+static constexpr uint32_t TEST_KEYS = 60000;
+static constexpr uint32_t TEST_OPS = 150000;
+static constexpr uint32_t TEST_READERS = 4;
+//rows a reader walks along the leaf chain per scan
+static constexpr uint32_t TEST_SCAN_ROWS = 500;
+static constexpr uint32_t TEST_READER_PAUSE_US = 200;
+//small enough that the tree doesn't fit and pages get evicted
+static constexpr uint32_t TEST_FRAMES = 64;
+
+static std::atomic<uint32_t> failures(0);
+
+static void fail(const std::string &mode, const std::string &what) {
+	if (failures++ < 10) {
+		std::cout << mode + ": " + what + "\n";
+	}
+}
+
+static std::string email_of(uint32_t id, const std::string &username) {
+	std::string email = "e" + std::to_string(id) + "-" + username + "-";
+	email.resize(Row::EMAIL_SIZE - 1, 'x');
+	return email;
+}
+
+static bool consistent(const char *record) {
+	RecordView view = view_record(record);
+	return view.email == email_of(view.id, std::string(view.username));
+}
+
+/**
+ * @brief range scans and point lookups until done, every row has to be
+ * whole and a scan has to see its ids in increasing order
+ */
+static void read_rows(Table &table, const std::atomic<bool> &done, uint32_t seed, const std::string &mode) {
+	std::mt19937 random(seed);
+	while (!done) {
+		{
+			Cursor c = table.tableSeek(random() % TEST_KEYS + 1);
+			uint32_t previous = 0;
+			for (uint32_t n = 0; n < TEST_SCAN_ROWS && !c.endOfTable; ++n, c.advance()) {
+				uint32_t id = c.key();
+				if (id <= previous || !consistent(c.value())) {
+					fail(mode, "scan saw a bad row at id " + std::to_string(id));
+					break;
+				}
+				previous = id;
+			}
+		}
+		for (uint32_t i = 0; i < 20; ++i) {
+			uint32_t key = random() % TEST_KEYS + 1;
+			Cursor c = table.tableFind(key);
+			if (c.cellNum < *leaf_node_num_cells(c.node) && c.key() == key && !consistent(c.value())) {
+				fail(mode, "lookup saw a bad row at id " + std::to_string(key));
+			}
+		}
+		//shared latches are preferred, readers that never pause starve the writer
+		std::this_thread::sleep_for(std::chrono::microseconds(TEST_READER_PAUSE_US));
+	}
+}
+
+static void run(const std::string &mode, const PagerOptions &options, const std::string &path) {
+	unlink(path.c_str());
+	unlink((path + "-wal").c_str());
+	Table table;
+	table.dbOpen(path, options);
+	table.createIndex(IndexColumn::Username);
+
+	std::atomic<bool> done(false);
+	std::vector<std::thread> readers;
+	for (uint32_t i = 0; i < TEST_READERS; ++i) {
+		readers.emplace_back(read_rows, std::ref(table), std::cref(done), i + 1, mode);
+	}
+
+	uint64_t internalSplits = stats.internalSplits;
+	uint64_t internalMerges = stats.internalMerges;
+	std::set<uint32_t> live;
+	std::mt19937 random(3);
+	for (uint32_t op = 1; op <= TEST_OPS; ++op) {
+		//grow the table first, then mostly shrink it, then mix
+		uint32_t phase = op * 3 / (TEST_OPS + 1);
+		uint32_t insertShare = phase == 0 ? 90 : phase == 1 ? 10 : 50;
+		uint32_t key = random() % TEST_KEYS + 1;
+		//while shrinking, aim at rows that exist so internal nodes underflow
+		if (phase == 1 && !live.empty()) {
+			auto it = live.lower_bound(key);
+			key = it == live.end() ? *live.begin() : *it;
+		}
+		uint32_t dice = random() % 100;
+		std::string username = "u" + std::to_string(random() % 50);
+		std::string email = email_of(key, username);
+
+		if (dice < insertShare) {
+			Row row;
+			memset(&row, 0, sizeof(row));
+			row.id = key;
+			strncpy(row.username, username.c_str(), Row::USERNAME_SIZE - 1);
+			strncpy(row.email, email.c_str(), Row::EMAIL_SIZE - 1);
+			table.insertRow(&row);
+			live.insert(key);
+		} else if (dice < insertShare + (100 - insertShare) * 2 / 3) {
+			table.deleteRow(key);
+			live.erase(key);
+		} else {
+			table.updateRow(key, username.c_str(), email.c_str());
+		}
+		table.autocommit();
+	}
+
+	done = true;
+	for (auto &reader : readers) {
+		reader.join();
+	}
+	if (stats.internalSplits == internalSplits || stats.internalMerges == internalMerges) {
+		fail(mode, "the tree never split or merged an internal node");
+	}
+	table.dbClose();
+	unlink(path.c_str());
+	unlink((path + "-wal").c_str());
+}
+
+int main(int argc, char *argv[]) {
+	std::string path = argc > 1 ? argv[1] : "concurrency_test.db";
+
+	PagerOptions buffered;
+	buffered.maxFrames = TEST_FRAMES;
+	run("buffered", buffered, path);
+
+	PagerOptions wal = buffered;
+	wal.wal.enabled = true;
+	run("wal", wal, path);
+
+	PagerOptions mmap;
+	mmap.mode = PagerMode::Mmap;
+	run("mmap", mmap, path);
+
+	if (failures > 0) {
+		std::cout << failures << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "concurrency_test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+#include <unistd.h>
+
+#include "table.hpp"
+#include "row.hpp"
+
+/*
+ * Email index whose internal nodes hold separators with a long common
+ * prefix, then get separators that share nothing with it. Split halves
+ * have to be sized by the bytes they take with their own prefix, a
+ * half that fits uncompressed can be far bigger than a page once it
+ * loses the long prefix.
+ */
+
+//enough rows for internal nodes of the index to be full of separators
+//that share the company name
+static constexpr uint32_t TEST_ROWS = 8000;
+//then rows sorting before and after all of them
+static constexpr uint32_t TEST_OUTLIERS = 300;
+static constexpr uint32_t TEST_FRAMES = 64;
+
+static uint32_t failures = 0;
+
+static void fail(const std::string &what) {
+	if (failures++ < 10) {
+		std::cout << what << std::endl;
+	}
+}
+
+static std::string company_email(uint32_t id) {
+	char email[Row::EMAIL_SIZE];
+	snprintf(email, sizeof(email), "verylongcompanyname-employee-%07u@example.com", id);
+	return email;
+}
+
+//as long as emails get, sorting before (a) or after (z) every company email
+static std::string outlier_email(char fill, uint32_t id) {
+	std::string number = std::to_string(id);
+	return std::string(Row::EMAIL_SIZE - 1 - number.size(), fill) + number;
+}
+
+static void insert(Table &table, uint32_t id, const std::string &email) {
+	Row row;
+	memset(&row, 0, sizeof(row));
+	row.id = id;
+	strncpy(row.username, "u", Row::USERNAME_SIZE - 1);
+	strncpy(row.email, email.c_str(), Row::EMAIL_SIZE - 1);
+	if (!table.insertRow(&row)) {
+		fail("insert of id " + std::to_string(id) + " failed");
+	}
+	table.autocommit();
+}
+
+static void expect(Table &table, const std::string &email, uint32_t id, const std::string &when) {
+	std::vector<uint32_t> ids;
+	table.indexLookup(IndexColumn::Email, email, ids);
+	if (ids.size() != 1 || ids[0] != id) {
+		fail(when + ": lookup of " + email + " found " + std::to_string(ids.size()) + " rows");
+	}
+}
+
+static void check(Table &table, const std::string &when) {
+	for (uint32_t id = 1; id <= TEST_ROWS; ++id) {
+		expect(table, company_email(id), id, when);
+	}
+	for (uint32_t i = 1; i <= TEST_OUTLIERS; ++i) {
+		expect(table, outlier_email('a', i), TEST_ROWS + i, when);
+		expect(table, outlier_email('z', i), TEST_ROWS + TEST_OUTLIERS + i, when);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	std::string path = argc > 1 ? argv[1] : "index_test.db";
+	unlink(path.c_str());
+
+	PagerOptions options;
+	options.maxFrames = TEST_FRAMES;
+	Table *table = new Table;
+	table->dbOpen(path, options);
+
+	for (uint32_t id = 1; id <= TEST_ROWS; ++id) {
+		insert(*table, id, company_email(id));
+	}
+	table->createIndex(IndexColumn::Email);
+	for (uint32_t i = 1; i <= TEST_OUTLIERS; ++i) {
+		insert(*table, TEST_ROWS + i, outlier_email('a', i));
+		insert(*table, TEST_ROWS + TEST_OUTLIERS + i, outlier_email('z', i));
+	}
+	check(*table, "after the inserts");
+
+	table->dbClose();
+	delete table;
+	table = new Table;
+	table->dbOpen(path, options);
+	check(*table, "after reopening");
+	table->dbClose();
+	delete table;
+	unlink(path.c_str());
+
+	if (failures > 0) {
+		std::cout << failures << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "index_test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <csignal>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.hpp"
+#include "protocol.hpp"
+#include "table.hpp"
+#include "cursor.hpp"
+#include "node.hpp"
+
+/*
+ * Two clients of one server: while one has a transaction open the
+ * other can neither write nor begin, and once the first hangs up in
+ * the middle of its transaction, what it wrote is committed and the
+ * other client can write again.
+ */
+
+//tries of a statement that is refused until the server closed a connection
+static constexpr uint32_t TEST_RETRIES = 500;
+static constexpr uint32_t TEST_RETRY_PAUSE_MS = 10;
+
+static uint32_t failures = 0;
+
+static void fail(const std::string &what) {
+	if (failures++ < 10) {
+		std::cout << what << std::endl;
+	}
+}
+
+static int connect_to(const std::string &path) {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) {
+		std::cout << "Unable to connect to " << path << ": " << strerror(errno) << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	return fd;
+}
+
+//send request and return every frame of the answer
+static std::string ask(int fd, const std::string &request) {
+	std::string answer;
+	std::string frame;
+	if (!send_frame(fd, request.data(), request.size()))
+		return "connection lost";
+	while (recv_frame(fd, frame) && !frame.empty()) {
+		answer += frame;
+	}
+	return answer;
+}
+
+static void expect(int fd, const std::string &request, const std::string &answer) {
+	std::string got = ask(fd, request);
+	if (got != answer) {
+		fail(request + " answered " + got);
+	}
+}
+
+//the server closes a connection after it saw the hang up, retry until then
+static void expect_eventually(int fd, const std::string &request, const std::string &answer) {
+	for (uint32_t i = 0; i < TEST_RETRIES; ++i) {
+		std::string got = ask(fd, request);
+		if (got == answer)
+			return;
+		std::this_thread::sleep_for(std::chrono::milliseconds(TEST_RETRY_PAUSE_MS));
+	}
+	fail(request + " never answered " + answer);
+}
+
+static bool has_row(Table &table, uint32_t key) {
+	Cursor c = table.tableFind(key);
+	return c.cellNum < *leaf_node_num_cells(c.node) && c.key() == key;
+}
+
+int main(int argc, char *argv[]) {
+	std::string path = argc > 1 ? argv[1] : "server_test.db";
+	std::string socketPath = path + ".sock";
+	unlink(path.c_str());
+
+	Table *table = new Table;
+	Server *server = new Server(table, socketPath, 2);
+	table->dbOpen(path);
+	std::thread loop(&Server::run, server);
+
+	int first = connect_to(socketPath);
+	int second = connect_to(socketPath);
+	expect(first, "begin", "Executed\n");
+	expect(first, "insert 1 alice alice@example.com", "Executed\n");
+	expect(second, "insert 2 bob bob@example.com", "Another connection has a transaction active\n");
+	expect(second, "begin", "A transaction is already active\n");
+	expect(second, "commit", "No transaction is active\n");
+	expect(second, "select where id = 2", "Executed\n");
+
+	//hang up without commit
+	close(first);
+	expect_eventually(second, "insert 2 bob bob@example.com", "Executed\n");
+	expect(second, "begin", "Executed\n");
+	expect(second, "insert 3 carol carol@example.com", "Executed\n");
+	close(second);
+
+	int third = connect_to(socketPath);
+	expect_eventually(third, "insert 4 dave dave@example.com", "Executed\n");
+	close(third);
+
+	kill(getpid(), SIGTERM);
+	loop.join();
+	delete server;
+	table->dbClose();
+	delete table;
+
+	table = new Table;
+	table->dbOpen(path);
+	for (uint32_t key = 1; key <= 4; ++key) {
+		if (!has_row(*table, key)) {
+			fail("row " + std::to_string(key) + " is missing after reopening");
+		}
+	}
+	table->dbClose();
+	delete table;
+	unlink(path.c_str());
+
+	if (failures > 0) {
+		std::cout << failures << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "server_test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,317 @@
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "table.hpp"
+#include "cursor.hpp"
+#include "node.hpp"
+#include "row.hpp"
+
+/*
+ * Random inserts, deletes and updates against a std::map of the same
+ * rows, in every pager mode. Lookups, range scans, full scans and the
+ * username index are compared with the map as the table changes, after
+ * a vacuum and after the file is opened again. Bulk loads have to
+ * account for every page they take.
+ */
+
+//ids are drawn from 1..keys, so inserts hit existing rows too; the
+//buffer pool gets enough of them for internal nodes to split and merge
+static constexpr uint32_t TEST_KEYS = 4000;
+static constexpr uint32_t TEST_OPS = 30000;
+static constexpr uint32_t TEST_DEEP_KEYS = 60000;
+static constexpr uint32_t TEST_DEEP_OPS = 150000;
+//the contents are compared with the map this often
+static constexpr uint32_t TEST_CHECKS = 10;
+//small enough that the tree doesn't fit and pages get evicted
+static constexpr uint32_t TEST_FRAMES = 64;
+
+typedef std::map<uint32_t, std::pair<std::string, std::string>> Oracle;
+
+static uint32_t failures = 0;
+
+static void fail(const std::string &mode, const std::string &what) {
+	if (failures++ < 10) {
+		std::cout << mode << ": " << what << std::endl;
+	}
+}
+
+static Row make_row(uint32_t id, const std::string &username, const std::string &email) {
+	Row row;
+	memset(&row, 0, sizeof(row));
+	row.id = id;
+	strncpy(row.username, username.c_str(), Row::USERNAME_SIZE - 1);
+	strncpy(row.email, email.c_str(), Row::EMAIL_SIZE - 1);
+	return row;
+}
+
+//a number after prefix, padded to between half of maxLength and maxLength
+static std::string random_text(std::mt19937 &random, const char *prefix, uint32_t maxLength) {
+	std::string text = prefix + std::to_string(random() % 50);
+	uint32_t length = maxLength / 2 + random() % (maxLength / 2 + 1);
+	text.append(length - std::min<uint32_t>(length, text.size()), 'x');
+	return text;
+}
+
+static bool matches(const char *record, uint32_t id, const Oracle::mapped_type &columns) {
+	RecordView view = view_record(record);
+	return view.id == id && view.username == columns.first && view.email == columns.second;
+}
+
+/**
+ * @brief compare the whole table with the oracle: a full scan, point
+ * lookups, range scans and lookups through the username index
+ */
+static void check(Table &table, const Oracle &oracle, uint32_t keys, std::mt19937 &random, const std::string &mode) {
+	{
+		Cursor c = table.tableStart();
+		auto it = oracle.begin();
+		for (; !c.endOfTable && it != oracle.end(); c.advance(), ++it) {
+			if (!matches(c.value(), it->first, it->second)) {
+				fail(mode, "scan differs at id " + std::to_string(it->first));
+				return;
+			}
+		}
+		if (!c.endOfTable || it != oracle.end()) {
+			fail(mode, "scan has a different number of rows");
+			return;
+		}
+	}
+
+	for (uint32_t i = 0; i < 200; ++i) {
+		uint32_t key = random() % keys + 1;
+		auto it = oracle.find(key);
+		Cursor c = table.tableFind(key);
+		bool found = c.cellNum < *leaf_node_num_cells(c.node) && c.key() == key;
+		if (found != (it != oracle.end()) || (found && !matches(c.value(), key, it->second))) {
+			fail(mode, "lookup of id " + std::to_string(key) + " differs");
+		}
+	}
+
+	for (uint32_t i = 0; i < 50; ++i) {
+		uint32_t key = random() % keys + 1;
+		Cursor c = table.tableSeek(key);
+		auto it = oracle.lower_bound(key);
+		for (uint32_t n = 0; n < 20 && it != oracle.end(); ++n, ++it, c.advance()) {
+			if (c.endOfTable || !matches(c.value(), it->first, it->second)) {
+				fail(mode, "range scan from id " + std::to_string(key) + " differs");
+				break;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < 50 && table.hasIndex(IndexColumn::Username); ++i) {
+		std::string username = "u" + std::to_string(random() % 50);
+		std::vector<uint32_t> expected;
+		for (auto &row : oracle) {
+			if (row.second.first == username) {
+				expected.push_back(row.first);
+			}
+		}
+		std::vector<uint32_t> ids;
+		table.indexLookup(IndexColumn::Username, username, ids);
+		if (ids != expected) {
+			fail(mode, "index lookup of " + username + " differs");
+		}
+	}
+}
+
+/**
+ * @brief ops random writes of ids up to keys, checked against the map
+ * @param deep the tree has to grow a level of internal nodes and
+ * shrink again
+ */
+static void run(const std::string &mode, const PagerOptions &options, const std::string &path,
+                uint32_t keys, uint32_t ops, bool deep) {
+	unlink(path.c_str());
+	unlink((path + "-wal").c_str());
+	std::mt19937 random(5);
+	Oracle oracle;
+
+	Table *table = new Table;
+	table->dbOpen(path, options);
+	table->createIndex(IndexColumn::Username);
+	uint64_t internalSplits = stats.internalSplits;
+	uint64_t internalMerges = stats.internalMerges;
+	uint32_t maxHeight = 0;
+
+	for (uint32_t op = 1; op <= ops; ++op) {
+		//grow the table first, then mostly shrink it, then mix
+		uint32_t phase = op * 3 / (ops + 1);
+		uint32_t dice = random() % 100;
+		uint32_t insertShare = phase == 0 ? 95 : phase == 1 ? 15 : 50;
+		uint32_t key = random() % keys + 1;
+		//while shrinking, aim at rows that exist so the table empties
+		//far enough for internal nodes to underflow
+		if (phase == 1 && !oracle.empty()) {
+			auto it = oracle.lower_bound(key);
+			key = it == oracle.end() ? oracle.begin()->first : it->first;
+		}
+		bool exists = oracle.count(key) > 0;
+
+		if (dice < insertShare) {
+			std::string username = "u" + std::to_string(random() % 50);
+			std::string email = random_text(random, "e", Row::EMAIL_SIZE - 1);
+			Row row = make_row(key, username, email);
+			if (table->insertRow(&row) == exists) {
+				fail(mode, "insert of id " + std::to_string(key) + " returned the wrong result");
+			}
+			if (!exists) {
+				oracle[key] = {username, email};
+			}
+		} else if (dice < insertShare + (100 - insertShare) * 2 / 3) {
+			if (table->deleteRow(key) != exists) {
+				fail(mode, "delete of id " + std::to_string(key) + " returned the wrong result");
+			}
+			oracle.erase(key);
+		} else {
+			std::string username = "u" + std::to_string(random() % 50);
+			std::string email = random_text(random, "f", Row::EMAIL_SIZE - 1);
+			if (table->updateRow(key, username.c_str(), email.c_str()) != exists) {
+				fail(mode, "update of id " + std::to_string(key) + " returned the wrong result");
+			}
+			if (exists) {
+				oracle[key] = {username, email};
+			}
+		}
+		table->autocommit();
+
+		if (op % (ops / TEST_CHECKS) == 0) {
+			check(*table, oracle, keys, random, mode);
+			maxHeight = std::max(maxHeight, table->measureTree(false).height);
+		}
+	}
+	if (deep && (maxHeight < 3 || stats.internalSplits == internalSplits || stats.internalMerges == internalMerges)) {
+		fail(mode, "the tree never split or merged an internal node");
+	}
+
+	table->vacuum();
+	check(*table, oracle, keys, random, mode + " after vacuum");
+
+	table->dbClose();
+	delete table;
+	table = new Table;
+	table->dbOpen(path, options);
+	check(*table, oracle, keys, random, mode + " after reopening");
+	table->dbClose();
+	delete table;
+
+	unlink(path.c_str());
+	unlink((path + "-wal").c_str());
+}
+
+//rows of the given ids, in that order
+struct IdSource : RowSource {
+	std::vector<uint32_t> ids;
+	size_t position = 0;
+
+	bool next(Row &row) override {
+		if (position == ids.size())
+			return false;
+		row = make_row(ids[position++], "u", "e");
+		return true;
+	}
+};
+
+/**
+ * @brief a load that finds its input unsorted and then a good one,
+ * every page of the file has to be in the tree or on the free list
+ */
+static void bulk_load(const std::string &path) {
+	unlink(path.c_str());
+	Table table;
+	PagerOptions options;
+	options.maxFrames = TEST_FRAMES;
+	table.dbOpen(path, options);
+
+	IdSource unsorted;
+	for (uint32_t id = 1; id <= TEST_KEYS * 4; ++id) {
+		unsorted.ids.push_back(id);
+	}
+	unsorted.ids.push_back(1);
+	if (table.bulkLoad(unsorted, 1) != BulkLoadUnsorted) {
+		fail("bulk load", "unsorted input wasn't refused");
+	}
+
+	IdSource sorted;
+	sorted.ids.assign(unsorted.ids.begin(), unsorted.ids.end() - 1);
+	if (table.bulkLoad(sorted, 1) != BulkLoadSuccess) {
+		fail("bulk load", "sorted input wasn't loaded");
+	}
+
+	Oracle oracle;
+	for (uint32_t id : sorted.ids) {
+		oracle[id] = {"u", "e"};
+	}
+	std::mt19937 random(7);
+	check(table, oracle, TEST_KEYS * 4, random, "bulk load");
+
+	TreeShape shape = table.measureTree(true);
+	Pager *pager = table.getPager();
+	uint64_t accounted = 1 + shape.leaves + shape.internalNodes + *meta_free_pages(pager->getPage(META_PAGE_NUM));
+	if (accounted != pager->getNumOfPages()) {
+		fail("bulk load", std::to_string(pager->getNumOfPages() - accounted) + " pages are lost");
+	}
+	table.dbClose();
+	unlink(path.c_str());
+}
+
+/**
+ * @brief a list of rows with a taken or repeated id inserts none of them
+ */
+static void insert_rows(const std::string &path) {
+	unlink(path.c_str());
+	Table table;
+	table.dbOpen(path);
+	Row first = make_row(1, "u", "e");
+	table.insertRow(&first);
+
+	Row taken[] = {make_row(2, "u", "e"), make_row(3, "u", "e"), make_row(1, "u", "e")};
+	Row repeated[] = {make_row(4, "u", "e"), make_row(5, "u", "e"), make_row(4, "u", "e")};
+	Row fresh[] = {make_row(6, "u", "e"), make_row(7, "u", "e")};
+	if (table.insertRows(taken, 3) || table.insertRows(repeated, 3) || !table.insertRows(fresh, 2)) {
+		fail("insert rows", "a list was inserted or refused wrongly");
+	}
+
+	Oracle oracle = {{1, {"u", "e"}}, {6, {"u", "e"}}, {7, {"u", "e"}}};
+	std::mt19937 random(9);
+	check(table, oracle, 8, random, "insert rows");
+	table.dbClose();
+	unlink(path.c_str());
+}
+
+int main(int argc, char *argv[]) {
+	std::string path = argc > 1 ? argv[1] : "table_test.db";
+
+	PagerOptions buffered;
+	buffered.maxFrames = TEST_FRAMES;
+	run("buffered", buffered, path, TEST_DEEP_KEYS, TEST_DEEP_OPS, true);
+
+	PagerOptions wal = buffered;
+	wal.wal.enabled = true;
+	run("wal", wal, path, TEST_KEYS, TEST_OPS, false);
+
+	PagerOptions compressed = buffered;
+	compressed.compress = true;
+	run("compressed", compressed, path, TEST_KEYS, TEST_OPS, false);
+
+	PagerOptions mmap;
+	mmap.mode = PagerMode::Mmap;
+	run("mmap", mmap, path, TEST_KEYS, TEST_OPS, false);
+
+	bulk_load(path);
+	insert_rows(path);
+
+	if (failures > 0) {
+		std::cout << failures << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "table_test passed" << std::endl;
+	return 0;
+}
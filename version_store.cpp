@@ -0,0 +1,95 @@
+#include "version_store.hpp"
+
+VersionStore::VersionStore() {
+    published = 0;
+    writing = false;
+    writingKey = 0;
+    writingExisted = false;
+}
+
+/**
+ * @brief note that key was written at version, call with mutex held
+ */
+void VersionStore::record(uint32_t key, uint64_t version, bool existed, const std::string &before) {
+	std::vector<Undo> &chain = versions[key];
+	if (!chain.empty() && chain.back().version == version)
+		return;
+	chain.push_back(Undo{version, existed, before});
+	history.push_back({version, key});
+}
+
+/**
+ * @brief drop the versions every open snapshot sees, all of them
+ * once the last snapshot closed. Call with mutex held.
+ */
+void VersionStore::collect() {
+	uint64_t oldest = snapshots.empty() ? UINT64_MAX : *snapshots.begin();
+	while (!history.empty() && history.front().first <= oldest) {
+		auto it = versions.find(history.front().second);
+		//history is in version order, so this is the oldest write of its chain
+		if (it != versions.end()) {
+			it->second.erase(it->second.begin());
+			if (it->second.empty()) {
+				versions.erase(it);
+			}
+		}
+		history.pop_front();
+	}
+}
+
+uint64_t VersionStore::beginWrite(uint32_t key, const char *before, uint32_t size) {
+	std::lock_guard<std::mutex> lock(mutex);
+	writing = true;
+	writingKey = key;
+	writingExisted = before != nullptr;
+	writingRecord.assign(before ? before : "", before ? size : 0);
+	if (!snapshots.empty()) {
+		record(key, published + 1, writingExisted, writingRecord);
+	}
+	return published + 1;
+}
+
+void VersionStore::endWrite() {
+	std::lock_guard<std::mutex> lock(mutex);
+	writing = false;
+	published++;
+}
+
+/**
+ * @brief snapshot of every write published so far
+ * @details A write in flight may already be in its leaf, it gets a
+ * version now if it went ahead without one while no reader was open.
+ */
+uint64_t VersionStore::openSnapshot() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (writing) {
+		record(writingKey, published + 1, writingExisted, writingRecord);
+	}
+	snapshots.insert(published);
+	return published;
+}
+
+void VersionStore::closeSnapshot(uint64_t snapshot) {
+	std::lock_guard<std::mutex> lock(mutex);
+	snapshots.erase(snapshots.find(snapshot));
+	collect();
+}
+
+uint64_t VersionStore::oldestSnapshot() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return snapshots.empty() ? UINT64_MAX : *snapshots.begin();
+}
+
+void VersionStore::olderVersions(uint64_t snapshot, uint32_t low, uint32_t high, std::vector<RowVersion> &rows) {
+	rows.clear();
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto it = versions.lower_bound(low); it != versions.end() && it->first <= high; ++it) {
+		//the first write after the snapshot replaced what it sees
+		for (const Undo &undo : it->second) {
+			if (undo.version > snapshot) {
+				rows.push_back(RowVersion{it->first, undo.existed, undo.record});
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef VERSION_STORE_H
+#define VERSION_STORE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <mutex>
+
+//what a snapshot sees of a row that was written after it
+struct RowVersion {
+	uint32_t key;
+	//false if the row didn't exist for the snapshot
+	bool existed;
+	//the record the snapshot sees, if it existed
+	std::string record;
+};
+
+/*********
+ VERSION STORE CLASS
+ Row versions behind snapshot reads. Writes are numbered
+ in the order they run. A write names the key it changes,
+ with the record it replaces, before it touches the leaf
+ and publishes its number once the change is in place. A
+ reader opens a snapshot at the last published write and,
+ for every key written after it, sees the record the key
+ held before the oldest of those writes: inserted rows
+ stay hidden, deleted and updated rows keep their old
+ record. So a scan sees the table as it was when it
+ started, however long it runs next to the writer.
+
+ Only writes a snapshot could miss are kept: none while no
+ reader is open, and once the oldest snapshot closes the
+ versions every remaining reader sees are collected.
+*********/
+class VersionStore {
+	struct Undo {
+		uint64_t version;
+		bool existed;
+		std::string record;
+	};
+
+	//number of the last write readers may see
+	uint64_t published;
+	//a write is between beginWrite() and endWrite(), on writingKey
+	bool writing;
+	uint32_t writingKey;
+	bool writingExisted;
+	std::string writingRecord;
+	//per key the writes since the oldest snapshot, oldest first,
+	//each with what the key held before it
+	std::map<uint32_t, std::vector<Undo>> versions;
+	//(version, key) oldest first, what collect() walks
+	std::deque<std::pair<uint64_t, uint32_t>> history;
+	//versions the open snapshots were taken at
+	std::multiset<uint64_t> snapshots;
+	std::mutex mutex;
+
+	void record(uint32_t key, uint64_t version, bool existed, const std::string &before);
+	void collect();
+
+public:
+	VersionStore();
+
+	/**
+	 * @brief the writer is about to change key, call before the leaf changes
+	 * @param before the record the key holds now, nullptr if it has none
+	 * @returns the number of this write
+	 */
+	uint64_t beginWrite(uint32_t key, const char *before = nullptr, uint32_t size = 0);
+	//the change is complete, snapshots opened from now on see it
+	void endWrite();
+
+	uint64_t openSnapshot();
+	void closeSnapshot(uint64_t snapshot);
+
+	//version of the oldest open snapshot, UINT64_MAX if none is open
+	uint64_t oldestSnapshot();
+
+	//the keys in [low, high] written after snapshot, in key order
+	void olderVersions(uint64_t snapshot, uint32_t low, uint32_t high, std::vector<RowVersion> &rows);
+};
+
+#endif
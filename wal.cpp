@@ -0,0 +1,333 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "wal.hpp"
+#include "pager.hpp"
+#include "stats.hpp"
+
+//frames handed to one pwritev call, two iovecs per frame
+static constexpr uint32_t WAL_FRAMES_PER_WRITE = 512;
+
+static uint32_t frameChecksum(const WalFrameHeader &h, const char *page) {
+	//FNV-1a over the frame header (minus the checksum) and the page
+	uint32_t hash = 2166136261u;
+	auto mix = [&hash](const char *p, size_t n) {
+		for (size_t i = 0; i < n; ++i) {
+			hash ^= (uint8_t)p[i];
+			hash *= 16777619u;
+		}
+	};
+	mix(reinterpret_cast<const char *>(&h.pageNum), sizeof(h.pageNum));
+	mix(reinterpret_cast<const char *>(&h.dbSize), sizeof(h.dbSize));
+	mix(reinterpret_cast<const char *>(&h.salt), sizeof(h.salt));
+	mix(reinterpret_cast<const char *>(&h.lsn), sizeof(h.lsn));
+	mix(page, PAGE_SIZE);
+	return hash;
+}
+
+Wal::Wal(std::string path, const WalOptions &options)
+    : path(path), options(options) {
+    fileDescriptor = -1;
+    salt = 0;
+    nextLsn = 1;
+    writeOffset = sizeof(WalHeader);
+    numOfFrames = 0;
+    dbSize = 0;
+    pendingCommits = 0;
+    stopping = false;
+}
+
+Wal::~Wal() {
+    if (syncer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(syncMutex);
+            stopping = true;
+        }
+        syncCond.notify_one();
+        syncer.join();
+    }
+}
+
+/**
+ * @brief open the log and recover every committed frame in it
+ */
+void Wal::_open() {
+	fileDescriptor = open(path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fileDescriptor == -1) {
+		std::cout << "Unable to open log file\n";
+		exit(EXIT_FAILURE);
+	}
+
+	recover();
+
+	if (options.enabled && options.groupCommitWindowMs > 0) {
+		syncer = std::thread(&Wal::syncLoop, this);
+	}
+}
+
+/**
+ * @brief rebuild the page index from the log
+ * @details Frames are read in order until the first one with a stale
+ * salt or a bad checksum. Only frames up to the last commit frame are
+ * kept, anything after it belongs to a commit that never finished and
+ * is cut off the log.
+ */
+void Wal::recover() {
+	struct stat st;
+	if (fstat(fileDescriptor, &st) == -1) {
+		std::cout << "Unable to stat log file\n";
+		exit(EXIT_FAILURE);
+	}
+
+	WalHeader header;
+	if ((uint64_t)st.st_size < sizeof(header) ||
+	    pread(fileDescriptor, &header, sizeof(header), 0) != sizeof(header) ||
+	    header.magic != WAL_MAGIC || header.pageSize != PAGE_SIZE) {
+		reset();
+		return;
+	}
+	salt = header.salt;
+
+	std::vector<std::pair<uint32_t, uint64_t>> uncommitted;
+	char *page = new char[PAGE_SIZE];
+	uint64_t offset = sizeof(header);
+	uint64_t committedEnd = offset;
+	uint32_t framesSeen = 0;
+
+	while (true) {
+		WalFrameHeader h;
+		if (pread(fileDescriptor, &h, sizeof(h), offset) != sizeof(h))
+			break;
+		if (h.salt != salt)
+			break;
+		if (pread(fileDescriptor, page, PAGE_SIZE, offset + sizeof(h)) != PAGE_SIZE)
+			break;
+		if (frameChecksum(h, page) != h.checksum)
+			break;
+
+		uncommitted.push_back({h.pageNum, offset + sizeof(h)});
+		framesSeen++;
+		offset += sizeof(h) + PAGE_SIZE;
+		nextLsn = h.lsn + 1;
+
+		if (h.dbSize != 0) {
+			for (auto &frame : uncommitted) {
+				index[frame.first] = frame.second;
+			}
+			uncommitted.clear();
+			committedEnd = offset;
+			numOfFrames = framesSeen;
+			dbSize = h.dbSize;
+		}
+	}
+	delete[] page;
+
+	writeOffset = committedEnd;
+	if (ftruncate(fileDescriptor, committedEnd) == -1) {
+		std::cout << "Error truncating log file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * @brief empty the log, frames written before this are ignored from now on
+ */
+void Wal::reset() {
+	std::lock_guard<std::mutex> lock(syncMutex);
+
+	salt = salt * 1103515245u + (uint32_t)std::chrono::steady_clock::now().time_since_epoch().count() + 1;
+	WalHeader header{WAL_MAGIC, PAGE_SIZE, salt, 0};
+
+	if (ftruncate(fileDescriptor, 0) == -1 ||
+	    pwrite(fileDescriptor, &header, sizeof(header), 0) != sizeof(header) ||
+	    fdatasync(fileDescriptor) == -1) {
+		std::cout << "Error resetting log file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+
+	index.clear();
+	numOfFrames = 0;
+	writeOffset = sizeof(header);
+	pendingCommits = 0;
+}
+
+/**
+ * @brief copy the latest logged image of pageNum into dest
+ * @return false if the log has no image of the page
+ */
+bool Wal::readPage(uint32_t pageNum, char *dest) {
+	auto it = index.find(pageNum);
+	if (it == index.end())
+		return false;
+
+	if (pread(fileDescriptor, dest, PAGE_SIZE, it->second) != PAGE_SIZE) {
+		std::cout << "Error reading log file\n";
+		exit(EXIT_FAILURE);
+	}
+	stat_add(stats.bytesRead, PAGE_SIZE);
+	return true;
+}
+
+/**
+ * @brief append page images to the log
+ * @param dbSize size of the database after the commit, the last frame
+ * becomes a commit frame. 0 appends the frames without committing.
+ */
+void Wal::appendFrames(const std::vector<std::pair<uint32_t, char *>> &pages, uint32_t dbSize) {
+	std::vector<WalFrameHeader> headers(pages.size());
+	std::vector<struct iovec> iov;
+	iov.reserve(2 * WAL_FRAMES_PER_WRITE);
+
+	for (size_t i = 0; i < pages.size(); ++i) {
+		WalFrameHeader &h = headers[i];
+		h.pageNum = pages[i].first;
+		h.dbSize = (i + 1 == pages.size()) ? dbSize : 0;
+		h.salt = salt;
+		h.lsn = nextLsn++;
+		h.checksum = frameChecksum(h, pages[i].second);
+	}
+
+	for (size_t start = 0; start < pages.size(); start += WAL_FRAMES_PER_WRITE) {
+		size_t end = std::min(pages.size(), (size_t)start + WAL_FRAMES_PER_WRITE);
+		iov.clear();
+		for (size_t i = start; i < end; ++i) {
+			iov.push_back({&headers[i], sizeof(WalFrameHeader)});
+			iov.push_back({pages[i].second, PAGE_SIZE});
+			index[pages[i].first] = writeOffset + (i - start) * (sizeof(WalFrameHeader) + PAGE_SIZE) + sizeof(WalFrameHeader);
+		}
+
+		ssize_t expected = (end - start) * (sizeof(WalFrameHeader) + PAGE_SIZE);
+		if (pwritev(fileDescriptor, iov.data(), iov.size(), writeOffset) != expected) {
+			std::cout << "Error writing to log file. Exiting...\n";
+			exit(EXIT_FAILURE);
+		}
+		stat_add(stats.bytesWritten, expected);
+		writeOffset += expected;
+	}
+	numOfFrames += pages.size();
+
+	if (dbSize == 0)
+		return;
+
+	this->dbSize = dbSize;
+	std::lock_guard<std::mutex> lock(syncMutex);
+	if (pendingCommits++ == 0) {
+		firstPending = std::chrono::steady_clock::now();
+	}
+	if (pendingCommits >= options.groupCommitSize || options.groupCommitWindowMs == 0) {
+		syncLocked();
+	} else {
+		syncCond.notify_one();
+	}
+}
+
+void Wal::syncLocked() {
+	if (fdatasync(fileDescriptor) == -1) {
+		std::cout << "Error syncing log file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+	pendingCommits = 0;
+}
+
+/**
+ * @brief make every commit appended so far durable
+ */
+void Wal::sync() {
+	std::lock_guard<std::mutex> lock(syncMutex);
+	if (pendingCommits > 0) {
+		syncLocked();
+	}
+}
+
+/**
+ * @brief syncer thread, closes the group commit window of pending commits
+ */
+void Wal::syncLoop() {
+	std::unique_lock<std::mutex> lock(syncMutex);
+	auto window = std::chrono::milliseconds(options.groupCommitWindowMs);
+	while (!stopping) {
+		if (pendingCommits == 0) {
+			syncCond.wait(lock);
+			continue;
+		}
+		auto deadline = firstPending + window;
+		if (std::chrono::steady_clock::now() < deadline) {
+			syncCond.wait_until(lock, deadline);
+			continue;
+		}
+		syncLocked();
+	}
+}
+
+/**
+ * @brief write the latest image of every logged page into the
+ * database file, in page order, and empty the log
+ * @details Only call this with no uncommitted frames in the log.
+ * @return size of the database in pages
+ */
+uint32_t Wal::checkpoint(int dbFileDescriptor) {
+	if (index.empty())
+		return dbSize;
+
+	std::vector<std::pair<uint32_t, uint64_t>> frames(index.begin(), index.end());
+	std::sort(frames.begin(), frames.end());
+
+	//aligned, the database file may be open for direct I/O
+	char *page = static_cast<char *>(aligned_alloc(PAGE_SIZE, PAGE_SIZE));
+	for (auto &frame : frames) {
+		if (pread(fileDescriptor, page, PAGE_SIZE, frame.second) != PAGE_SIZE) {
+			std::cout << "Error reading log file\n";
+			exit(EXIT_FAILURE);
+		}
+		if (pwrite(dbFileDescriptor, page, PAGE_SIZE, (off_t)frame.first * PAGE_SIZE) != PAGE_SIZE) {
+			std::cout << "Error writing to file. Exiting...\n";
+			exit(EXIT_FAILURE);
+		}
+		stat_add(stats.bytesRead, PAGE_SIZE);
+		stat_add(stats.bytesWritten, PAGE_SIZE);
+	}
+	free(page);
+
+	struct stat st;
+	if (fstat(dbFileDescriptor, &st) == 0 && (uint64_t)st.st_size < (uint64_t)dbSize * PAGE_SIZE) {
+		if (ftruncate(dbFileDescriptor, (off_t)dbSize * PAGE_SIZE) == -1) {
+			std::cout << "Error extending file. Exiting...\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (fsync(dbFileDescriptor) == -1) {
+		std::cout << "Error syncing file. Exiting...\n";
+		exit(EXIT_FAILURE);
+	}
+
+	reset();
+	return dbSize;
+}
+
+int Wal::_close(bool remove) {
+	if (syncer.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(syncMutex);
+			stopping = true;
+		}
+		syncCond.notify_one();
+		syncer.join();
+	}
+	sync();
+
+	int result = close(fileDescriptor);
+	fileDescriptor = -1;
+	if (remove) {
+		unlink(path.c_str());
+	}
+	return result;
+}
@@ -0,0 +1,104 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+static constexpr uint32_t WAL_MAGIC = 0x57414c31;
+
+struct WalOptions {
+	bool enabled = false;
+	//fsync the log once this many commits are pending...
+	uint32_t groupCommitSize = 32;
+	//...or once the oldest pending commit is this old
+	uint32_t groupCommitWindowMs = 10;
+	//copy the log into the database file once it holds this many frames
+	uint32_t checkpointFrames = 1000;
+};
+
+/*
+ * Log Layout
+ * The log starts with a header followed by frames. Every frame
+ * is a header and a full page image. The last frame of a commit
+ * carries the size of the database (in pages) after the commit,
+ * all other frames carry 0. Recovery replays frames up to the
+ * last commit frame with a valid salt and checksum.
+ */
+struct WalHeader {
+	uint32_t magic;
+	uint32_t pageSize;
+	//changes every time the log is reset, so stale frames are ignored
+	uint32_t salt;
+	uint32_t reserved;
+};
+
+struct WalFrameHeader {
+	uint32_t pageNum;
+	uint32_t dbSize;
+	uint32_t salt;
+	uint32_t checksum;
+	uint64_t lsn;
+};
+
+/*********
+ WAL CLASS
+ Write-ahead log of physical page images. Pages changed by a
+ commit are appended to the log with one sequential write, the
+ database file is only written in place when the log is
+ checkpointed. The log is fsync'ed in groups: a commit returns
+ as soon as its frames are written, and a commit that fills the
+ group or the syncer thread at the end of the window makes all
+ pending commits durable with one fsync.
+*********/
+class Wal {
+	std::string path;
+	int fileDescriptor;
+	WalOptions options;
+	uint32_t salt;
+	uint64_t nextLsn;
+	uint64_t writeOffset;
+	uint32_t numOfFrames;
+	//database size after the last commit
+	uint32_t dbSize;
+	//pageNum -> offset of the latest image of that page in the log
+	std::unordered_map<uint32_t, uint64_t> index;
+
+	std::mutex syncMutex;
+	std::condition_variable syncCond;
+	std::thread syncer;
+	uint32_t pendingCommits;
+	std::chrono::steady_clock::time_point firstPending;
+	bool stopping;
+
+	void recover();
+	void reset();
+	void syncLocked();
+	void syncLoop();
+
+public:
+	Wal(std::string path, const WalOptions &options);
+	~Wal();
+
+	void _open();
+	bool readPage(uint32_t pageNum, char *dest);
+	void appendFrames(const std::vector<std::pair<uint32_t, char *>> &pages, uint32_t dbSize);
+	void sync();
+	uint32_t checkpoint(int dbFileDescriptor);
+	int _close(bool remove);
+
+	inline uint32_t getNumOfFrames() {
+		return numOfFrames;
+	}
+
+	inline uint32_t getDbSize() {
+		return dbSize;
+	}
+};
+
+#endif